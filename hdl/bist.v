@@ -0,0 +1,192 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ * Author: Darrell Harmon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ *
+ * Built in self test source and sink for the user side of a FIFO, to
+ * measure DMA throughput without the host generating or checking data.
+ *
+ * The patterns match user/Pattern.cpp, qword 0 of a FIFO word first:
+ * lfsr = 0: COUNTER, each qword is the previous + 1
+ * lfsr = 1: LFSR, each qword is xorshift64 of the previous, the seed
+ *           must not be 0
+ *
+ * restart clears the counts and, for the source, loads seed as the next
+ * qword. span is the clock cycles from the first word to the last.
+ */
+
+module bist_source
+  (
+   input 		 clock,
+   input 		 reset,
+   input 		 restart,
+   input 		 enable,
+   input 		 lfsr,
+   input [63:0] 	 seed,
+   // to PC FIFO
+   input 		 fifo_ready,
+   output reg 		 fifo_write = 0,
+   output reg [64*W-1:0] fifo_data = 0,
+   // counts
+   output reg [31:0] 	 words = 0,
+   output reg [31:0] 	 span = 0
+   );
+
+   parameter W = 1; // qwords per FIFO word
+
+   function [63:0] next_q;
+      input [63:0] x;
+      input 	   l;
+      reg [63:0]   a, b;
+      begin
+	 a = x ^ (x << 13);
+	 b = a ^ (a >> 7);
+	 next_q = l ? b ^ (b << 17) : x + 1'b1;
+      end
+   endfunction
+
+   reg [63:0] 		 state = 0; // next qword to send
+   reg [31:0] 		 cycles = 0;
+   reg 			 started = 0;
+   reg [64*W-1:0] 	 word;
+   integer 		 i;
+
+   wire 		 write = enable && fifo_ready && ~reset && ~restart;
+
+   always @ (*)
+     begin
+	word[63:0] = state;
+	for(i=1; i<W; i=i+1)
+	  word[64*i +: 64] = next_q(word[64*(i-1) +: 64], lfsr);
+     end
+
+   always @ (posedge clock)
+     begin
+	fifo_write <= write;
+	if(write)
+	  fifo_data <= word;
+	if(reset || restart)
+	  begin
+	     state <= seed;
+	     words <= 1'b0;
+	     span <= 1'b0;
+	     cycles <= 1'b0;
+	     started <= 1'b0;
+	  end
+	else
+	  begin
+	     if(write)
+	       state <= next_q(word[64*W-1 -: 64], lfsr);
+	     words <= words + write;
+	     started <= started | write;
+	     cycles <= cycles + (started | write);
+	     if(write)
+	       span <= cycles;
+	  end
+     end
+
+endmodule
+
+/*
+ * Reads whenever enabled. With check set, each qword is compared with
+ * the prediction from the one before it and mismatches are counted in
+ * errors, the first qword after restart is the seed.
+ */
+module bist_sink
+  (
+   input 		clock,
+   input 		reset,
+   input 		restart,
+   input 		enable,
+   input 		check,
+   input 		lfsr,
+   // from PC FIFO, first word fall through
+   input 		fifo_valid,
+   output 		fifo_read,
+   input [64*W-1:0] 	fifo_data,
+   // counts
+   output reg [31:0] 	words = 0,
+   output reg [31:0] 	errors = 0,
+   output reg [31:0] 	span = 0
+   );
+
+   parameter W = 1; // qwords per FIFO word
+
+   function [63:0] next_q;
+      input [63:0] x;
+      input 	   l;
+      reg [63:0]   a, b;
+      begin
+	 a = x ^ (x << 13);
+	 b = a ^ (a >> 7);
+	 next_q = l ? b ^ (b << 17) : x + 1'b1;
+      end
+   endfunction
+
+   reg 			d_valid = 0;
+   reg [64*W-1:0] 	d_data = 0;
+   reg [63:0] 		prev = 0; // last qword checked
+   reg 			seeded = 0;
+   reg [31:0] 		cycles = 0;
+   reg 			started = 0;
+   reg [1:0] 		n_errors;
+   reg [63:0] 		p;
+   integer 		i;
+
+   assign fifo_read = enable && fifo_valid && ~reset && ~restart;
+
+   always @ (*)
+     begin
+	n_errors = 0;
+	p = prev;
+	for(i=0; i<W; i=i+1)
+	  begin
+	     if((seeded || (i != 0)) && (d_data[64*i +: 64] != next_q(p, lfsr)))
+	       n_errors = n_errors + 1'b1;
+	     p = d_data[64*i +: 64];
+	  end
+     end
+
+   always @ (posedge clock)
+     begin
+	d_valid <= fifo_read;
+	d_data <= fifo_data;
+	if(reset || restart)
+	  begin
+	     words <= 1'b0;
+	     errors <= 1'b0;
+	     span <= 1'b0;
+	     cycles <= 1'b0;
+	     started <= 1'b0;
+	     seeded <= 1'b0;
+	  end
+	else
+	  begin
+	     words <= words + fifo_read;
+	     started <= started | fifo_read;
+	     cycles <= cycles + (started | fifo_read);
+	     if(fifo_read)
+	       span <= cycles;
+	     if(d_valid && check)
+	       begin
+		  errors <= errors + n_errors;
+		  prev <= d_data[64*W-1 -: 64];
+		  seeded <= 1'b1;
+	       end
+	  end
+     end
+
+endmodule
@@ -1,4 +1,30 @@
 `include "buildtime.vh"
 `define USE_GT_DRP
-`define NLANES 4
-`define ENABLE 8'b01110111
+// DATA128: 128 bit core interface, x8 lanes, 16 byte FIFO words. The
+// core must be generated to match. Default is 64 bits, x4, 8 byte words.
+`ifdef DATA128
+ `define NLANES 8
+ `define DBITS 128
+`else
+ `define NLANES 4
+ `define DBITS 64
+`endif
+// channels in each direction, 1 to 32. More than 8 needs extended tags,
+// see register 9 in hififo.v.
+`ifndef NCH
+ `define NCH 4
+`endif
+// channels present, bit per channel
+`define FPC_ENABLE 32'h7
+`define TPC_ENABLE 32'h7
+// FPC read tags per FIFO, 2**n, 2 to 6, at most 8 bits with the FIFO
+// number. Without extended tags the FIFOs fall back to 32 tags in all
+// at runtime.
+`ifndef FPC_TAG_BITS
+ `define FPC_TAG_BITS 3
+`endif
+// largest FPC read request, 2**n qwords, 4 to 9, 5 to 9 with DATA128.
+// Requests are cut to the max read request size the host negotiated.
+`ifndef FPC_REQ_BITS
+ `define FPC_REQ_BITS 6
+`endif
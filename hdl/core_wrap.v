@@ -31,6 +31,7 @@ module pcie_core_wrap
    input 		   sys_rst_n,
    //
    output [15:0] 	   pci_id,
+   output [15:0] 	   cfg_dcommand, // device control register
    input 		   interrupt,
    output 		   interrupt_rdy,
    output reg 		   pci_reset = 1,
@@ -45,14 +46,16 @@ module pcie_core_wrap
    output 		   gt_drp_clock,
    // AXI to core
    output 		   s_axis_tx_tready,
-   input [63:0] 	   s_axis_tx_tdata,
-   input 		   s_axis_tx_1dw,
+   input [`DBITS-1:0] 	   s_axis_tx_tdata,
+   input [`DBITS/32-1:0]   s_axis_tx_keep, // DW enables
    input 		   s_axis_tx_tlast,
    input 		   s_axis_tx_tvalid,
    // AXI from core
    output 		   m_axis_rx_tvalid,
    output 		   m_axis_rx_tlast,
-   output [63:0] 	   m_axis_rx_tdata
+   output [4:0] 	   m_axis_rx_sof, // is_sof, 128 bit only
+   output [4:0] 	   m_axis_rx_eof, // is_eof, 128 bit only
+   output [`DBITS-1:0] 	   m_axis_rx_tdata
    );
 
    wire 	user_reset;
@@ -60,7 +63,25 @@ module pcie_core_wrap
    wire 	cfg_to_turnoff;
    wire 	sys_rst_n_c;
    wire 	sys_clk;
+   wire [21:0] 	rx_tuser;
+   wire [`DBITS/8-1:0] tx_tkeep;
    reg 		cfg_turnoff_ok = 0;
+
+   genvar 	i;
+   generate
+      for (i = 0; i < `DBITS/32; i = i+1) begin: keep
+	 assign tx_tkeep[4*i+3:4*i] = {4{s_axis_tx_keep[i]}};
+      end
+   endgenerate
+
+`ifdef DATA128
+   assign m_axis_rx_sof = rx_tuser[14:10];
+   assign m_axis_rx_eof = rx_tuser[21:17];
+`else
+   assign m_axis_rx_sof = 5'd0;
+   assign m_axis_rx_eof = 5'd0;
+`endif
+
    always @(posedge clock)
      begin
 	pci_reset <= user_reset | ~user_lnk_up;
@@ -87,7 +108,7 @@ module pcie_core_wrap
       .user_app_rdy(),
       .s_axis_tx_tready(s_axis_tx_tready),
       .s_axis_tx_tdata(s_axis_tx_tdata),
-      .s_axis_tx_tkeep(s_axis_tx_1dw ? 8'h0F : 8'hFF),
+      .s_axis_tx_tkeep(tx_tkeep),
       .s_axis_tx_tuser(4'd0), // may want to assert 2 for cut through
       .s_axis_tx_tlast(s_axis_tx_tlast),
       .s_axis_tx_tvalid(s_axis_tx_tvalid),
@@ -96,7 +117,7 @@ module pcie_core_wrap
       .m_axis_rx_tlast(m_axis_rx_tlast),
       .m_axis_rx_tvalid(m_axis_rx_tvalid),
       .m_axis_rx_tready(1'b1), // always ready
-      .m_axis_rx_tuser(),
+      .m_axis_rx_tuser(rx_tuser),
 
       .tx_cfg_gnt(1'b1), .rx_np_ok(1'b1), .rx_np_req(1'b1),
       .cfg_trn_pending(1'b0),
@@ -115,7 +136,7 @@ module pcie_core_wrap
       .cfg_dcommand2(), .cfg_pmcsr_pme_status(),
       .cfg_status(), .cfg_to_turnoff(cfg_to_turnoff),
       .cfg_received_func_lvl_rst(),
-      .cfg_dcommand(),
+      .cfg_dcommand(cfg_dcommand),
       .cfg_bus_number(pci_id[15:8]),
       .cfg_device_number(pci_id[7:3]),
       .cfg_function_number(pci_id[2:0]),
@@ -242,6 +263,7 @@ module pcie_core_wrap
    input 		   sys_clk_n,
    input 		   sys_rst_n,
    output reg [15:0] 	   pci_id = 16'hDEAD,
+   output reg [15:0] 	   cfg_dcommand = 16'h2100, // MRRS 512, ext tags
    input 		   interrupt,
    output reg 		   interrupt_rdy = 0,
    output reg 		   pci_reset = 0,
@@ -256,18 +278,60 @@ module pcie_core_wrap
    output 		   gt_drp_clock,
    // AXI to core
    output reg 		   s_axis_tx_tready = 0,
-   input [63:0] 	   s_axis_tx_tdata,
-   input 		   s_axis_tx_1dw,
+   input [`DBITS-1:0] 	   s_axis_tx_tdata,
+   input [`DBITS/32-1:0]   s_axis_tx_keep,
    input 		   s_axis_tx_tlast,
    input 		   s_axis_tx_tvalid,
    // AXI from core
    output reg 		   m_axis_rx_tvalid = 0,
    output reg 		   m_axis_rx_tlast = 0,
-   output reg [63:0] 	   m_axis_rx_tdata = 0
+   output reg [4:0] 	   m_axis_rx_sof = 0,
+   output reg [4:0] 	   m_axis_rx_eof = 0,
+   output reg [`DBITS-1:0] m_axis_rx_tdata = 0
    );
 
    always @ (posedge clock)
      interrupt_rdy <= interrupt;
+
+   initial
+     if($value$plusargs("dcommand=%h", cfg_dcommand))
+       $display("cfg_dcommand = %h", cfg_dcommand);
+
+`ifdef VERILATOR
+   // the PCI Express host is a C++ model, testbenches/verilator/PcieSim.cpp
+   // 64 bit beats are 2 DWs, 128 bit beats 4, data in two longints
+   import "DPI-C" function void hififo_sim_cycle
+     (input int dwords, input bit tx_valid, input longint tx_data_0,
+      input longint tx_data_1, input int tx_keep, input bit tx_last,
+      input bit interrupt,
+      output bit tx_ready, output bit rx_valid, output longint rx_data_0,
+      output longint rx_data_1, output int rx_sof, output int rx_eof,
+      output bit reset);
+
+   localparam [127:0] TX_PAD = 0;
+   wire [127:0]	tx_data = {TX_PAD, s_axis_tx_tdata};
+   bit 		dpi_tx_ready, dpi_rx_valid, dpi_reset;
+   longint 	dpi_rx_data_0, dpi_rx_data_1;
+   int 		dpi_rx_sof, dpi_rx_eof;
+
+   always @ (*)
+     clock = sys_clk_p;
+
+   always @ (posedge clock)
+     begin
+	hififo_sim_cycle(`DBITS/32, s_axis_tx_tvalid, tx_data[63:0],
+			 tx_data[127:64], s_axis_tx_keep, s_axis_tx_tlast,
+			 interrupt, dpi_tx_ready, dpi_rx_valid, dpi_rx_data_0,
+			 dpi_rx_data_1, dpi_rx_sof, dpi_rx_eof, dpi_reset);
+	s_axis_tx_tready <= dpi_tx_ready;
+	m_axis_rx_tvalid <= dpi_rx_valid;
+	m_axis_rx_tdata <= {dpi_rx_data_1, dpi_rx_data_0};
+	m_axis_rx_sof <= dpi_rx_sof;
+	m_axis_rx_eof <= dpi_rx_eof;
+	m_axis_rx_tlast <= dpi_rx_eof[4];
+	pci_reset <= dpi_reset;
+     end
+`endif
 endmodule
 
 `endif
\ No newline at end of file
@@ -36,7 +36,7 @@ module fwft_fifo
    output 	      o_almost_empty
    );
 
-   parameter NBITS = 64; // 1 to 72 valid
+   parameter NBITS = 64; // 1 to 144 valid, above 72 is two FIFOs
    parameter FULL_OFFSET = 9'h080;
 
 `ifdef SIM
@@ -76,10 +76,36 @@ module fwft_fifo
 
 `else
    wire empty, almostfull;
-   assign i_ready = ~almostfull;
-   assign o_valid = ~empty;
+   wire i_ready_lo, o_valid_lo;
+   assign i_ready = (NBITS > 72) ? i_ready_lo : ~almostfull;
+   assign o_valid = (NBITS > 72) ? o_valid_lo : ~empty;
    generate
-      if(NBITS>36) begin : fifo_36
+      if(NBITS>72) begin : fifo_wide
+	 // both halves see the same writes and reads, flags are from one
+	 fwft_fifo #(.NBITS(NBITS/2), .FULL_OFFSET(FULL_OFFSET)) fifo_lo
+	   (.reset(reset),
+	    .i_clock(i_clock),
+	    .i_data(i_data[NBITS/2-1:0]),
+	    .i_valid(i_valid),
+	    .i_ready(i_ready_lo),
+	    .o_clock(o_clock),
+	    .o_read(o_read),
+	    .o_data(o_data[NBITS/2-1:0]),
+	    .o_valid(o_valid_lo),
+	    .o_almost_empty(o_almost_empty));
+	 fwft_fifo #(.NBITS(NBITS-NBITS/2), .FULL_OFFSET(FULL_OFFSET)) fifo_hi
+	   (.reset(reset),
+	    .i_clock(i_clock),
+	    .i_data(i_data[NBITS-1:NBITS/2]),
+	    .i_valid(i_valid),
+	    .i_ready(),
+	    .o_clock(o_clock),
+	    .o_read(o_read),
+	    .o_data(o_data[NBITS-1:NBITS/2]),
+	    .o_valid(),
+	    .o_almost_empty());
+      end
+      else if(NBITS>36) begin : fifo_36
 	 FIFO_DUALCLOCK_MACRO
 	   #(
 	     .ALMOST_EMPTY_OFFSET(9'h00F),
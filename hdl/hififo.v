@@ -19,6 +19,31 @@
 `timescale 1ns/1ps
 `include "config.vh"
 
+/*
+ * NCH channels in each direction. FIFO n < NCH is from PC channel n,
+ * FIFO NCH + n is to PC channel n. fifo_clock, fifo_reset, fifo_rw and
+ * fifo_ready are indexed by FIFO number, the data buses carry a FIFO
+ * word per channel, channel 0 in the LSBs. FIFO words are `DBITS bits,
+ * the width of the core interface, and host transfers must be a
+ * multiple of the word size.
+ *
+ * BAR0, 64 bit qwords, reads return the low 32 bits:
+ * 0: read: from PC interrupt status, bit per channel, clear on read
+ * 1: read: from PC channels present
+ * 2: read: build time
+ * 3: write: set FIFO resets, from PC in bits 31:0, to PC in 63:32
+ * 4: write: clear FIFO resets, as 3
+ * 5: read: to PC channels present, write: clear performance counters
+ * 6: read: to PC interrupt status, clear on read
+ * 7: read: NCH
+ * 8: read: FIFO word bytes
+ * 9: read: bit 0 extended tags enabled by the host, bit 1 from PC FIFOs
+ *    need extended tags, NCH > 8
+ * 16 to 63: performance counters
+ * 64 + n: FIFO n registers, see hififo_fetch_descriptor.v
+ * BAR0 is 1 KB, 128 qwords, for up to 32 channels each way
+ */
+
 module hififo_pcie
   (
    // IO pins
@@ -42,26 +67,35 @@ module hififo_pcie
    output 		   gt_drp_clock,
    `endif
    // FIFOs
-   input [7:0] 		   fifo_clock,
-   output [7:0] 	   fifo_reset,
-   input [7:0] 		   fifo_rw,
-   output [7:0] 	   fifo_ready,
-   output [63:0] 	   fifo_data_0,
-   output [63:0] 	   fifo_data_1,
-   output [63:0] 	   fifo_data_2,
-   output [63:0] 	   fifo_data_3,
-   input [63:0] 	   fifo_data_4,
-   input [63:0] 	   fifo_data_5,
-   input [63:0] 	   fifo_data_6,
-   input [63:0] 	   fifo_data_7
+   input [2*`NCH-1:0] 	   fifo_clock,
+   output [2*`NCH-1:0] 	   fifo_reset,
+   input [2*`NCH-1:0] 	   fifo_rw,
+   output [2*`NCH-1:0] 	   fifo_ready,
+   output [`DBITS*`NCH-1:0] fifo_fpc_data,
+   input [`DBITS*`NCH-1:0]  fifo_tpc_data
    );
 
+   localparam NCH = `NCH;
+   localparam W = `DBITS / 64; // qwords per FIFO word
+   localparam NF = 2*NCH;
+   localparam [31:0] FPC_EN = `FPC_ENABLE;
+   localparam [31:0] TPC_EN = `TPC_ENABLE;
+   // by FIFO number
+   localparam [63:0] EN = ({32'd0, TPC_EN} << NCH) |
+			  (FPC_EN & ((64'd1 << NCH) - 1'b1));
+   // FPC FIFO number bits in the read tag, the tag slots get the rest
+   localparam FBITS = (NCH > 16) ? 5 : (NCH > 8) ? 4 : (NCH > 4) ? 3 : 2;
+   localparam TBITS = (`FPC_TAG_BITS > 8 - FBITS) ?
+		      8 - FBITS : `FPC_TAG_BITS;
+
    wire [15:0] 	 pci_id;
+   wire [15:0] 	 cfg_dcommand;
    wire 	 pci_reset;
 
-   // from RX module
-   wire 	 rx_rc_valid;
-   wire [5:0] 	 rx_rc_index;
+   // from RX module, completions in W qword lanes
+   wire [W-1:0]  rx_rc_valid;
+   wire [9*W-1:0] rx_rc_index;
+   wire [64*W-1:0] rx_rc_data;
    wire [7:0] 	 rx_rc_tag;
    wire 	 rx_wr_valid;
    wire 	 rx_rr_valid;
@@ -69,7 +103,8 @@ module hififo_pcie
    wire [7:0] 	 rx_rr_addr;
    reg 		 rx_rr_ready;
    wire [63:0] 	 rx_data;
-   wire [5:0] 	 rx_address;
+   wire [6:0] 	 rx_address;
+   wire [6:0] 	 rx_rr_qword = rx_rr_addr[7:1];
 
    // read completion request to TX module
    wire [31:0] 	 tx_rc_dw2 = {rx_rr_rid_tag, 1'b0, rx_rr_addr[4:0], 2'd0};
@@ -77,35 +112,51 @@ module hififo_pcie
    reg 		 tx_rc_valid = 0;
    wire 	 tx_rc_ready;
 
-   wire [3:0] 	 mux_rr_valid, mux_rr_ready;
-   wire [63:0] 	 mux_rr_addr [0:3];
-   wire [2:0] 	 mux_rr_tag [0:3];
+   wire [NCH-1:0]    mux_rr_valid, mux_rr_ready;
+   wire [64*NCH-1:0] mux_rr_addr;
+   wire [8*NCH-1:0]  mux_rr_tag;
+   wire [10*NCH-1:0] mux_rr_len;
+
+   wire [NCH-1:0]    mux_wr_valid, mux_wr_ready, mux_wr_last;
+   wire [64*W*NCH-1:0] mux_wr_data;
+   wire [64*NCH-1:0] mux_wr_addr;
+   wire [5*NCH-1:0]  mux_wr_len;
 
-   wire [3:0] 	 mux_wr_valid, mux_wr_ready;
-   wire [63:0] 	 mux_wr_data[0:3];
-   wire [63:0] 	 mux_wr_addr[0:3];
-   wire [3:0] 	 mux_wr_last;
+   wire [31:0] 	 status[0:NF-1];
 
-   wire [31:0] 	 status[0:7];
+   /*
+    * performance counters, BAR0 qwords 16 to 63, 32 bits, free running
+    * from the last write to qword 5 or PCI reset
+    * 16: clock cycles
+    * 17, 18: TX cycles a word was sent, cycles held off by the core
+    * 19, 20, 21: TX completion, read request, write request TLPs
+    * 22, 23: RX busy cycles, RX TLPs
+    * 24 + 6n, from PC channel n < 4: read requests, cycles all tags
+    *   outstanding, cycles the user FIFO was full, sum and max of request
+    *   to last completion latency in cycles,
+    *   max << 16 | min of FIFO words requested not yet in the user FIFO
+    * 48 + 4n, to PC channel n < 4: FIFO words sent, cycles waiting for the
+    *   TX arbiter, cycles the user FIFO was empty with room in the host
+    *   ring, cycles data waited on a full host ring
+    */
+   wire [31:0] 	 perf[16:63];
+   wire [191:0]  fpc_perf[0:3];
+   wire [127:0]  tpc_perf[0:3];
+   reg 		 perf_clear = 0;
+   reg [31:0] 	 perf_cycles = 0;
+   reg [31:0] 	 perf_rx_busy = 0;
+   reg [31:0] 	 perf_rx_tlps = 0;
+   wire [31:0] 	 perf_tx_busy, perf_tx_stall;
+   wire [31:0] 	 perf_tx_rc, perf_tx_rr, perf_tx_wr;
 
    // interrupts
    reg 		 interrupt;
    wire 	 interrupt_rdy;
-   reg [7:0] 	 interrupt_status = 0;
-   wire [7:0] 	 interrupt_individual;
+   reg [NCH-1:0] interrupt_fpc = 0;
+   reg [NCH-1:0] interrupt_tpc = 0;
+   wire [NF-1:0] interrupt_individual;
 
-   wire [63:0] 	 fifo_data[0:7];
-
-   reg [7:0] 	 fifo_reset_sysclock;
-
-   assign fifo_data_0 = fifo_data[0];
-   assign fifo_data_1 = fifo_data[1];
-   assign fifo_data_2 = fifo_data[2];
-   assign fifo_data_3 = fifo_data[3];
-   assign fifo_data[4] = fifo_data_4;
-   assign fifo_data[5] = fifo_data_5;
-   assign fifo_data[6] = fifo_data_6;
-   assign fifo_data[7] = fifo_data_7;
+   reg [NF-1:0]  fifo_reset_sysclock;
 
    reg [1:0] 	 read = 0;
    reg 		 read_in_progress = 0;
@@ -114,18 +165,29 @@ module hififo_pcie
      begin
 	interrupt <= (interrupt_individual != 0)
 	  | (interrupt & ~interrupt_rdy & ~pci_reset);
-	if(pci_reset | (read[1] && (rx_rr_addr[4:1] == 0)))
-	  interrupt_status <= 1'b0;
+	// a read clears the status, keeping any set in the same cycle
+	if(pci_reset)
+	  interrupt_fpc <= 1'b0;
+	else if(read[1] && (rx_rr_qword == 0))
+	  interrupt_fpc <= interrupt_individual[NCH-1:0];
 	else
-	  interrupt_status <= interrupt_status | interrupt_individual;
+	  interrupt_fpc <= interrupt_fpc | interrupt_individual[NCH-1:0];
 	if(pci_reset)
-	  fifo_reset_sysclock <= 8'hFF;
+	  interrupt_tpc <= 1'b0;
+	else if(read[1] && (rx_rr_qword == 6))
+	  interrupt_tpc <= interrupt_individual[NF-1:NCH];
+	else
+	  interrupt_tpc <= interrupt_tpc | interrupt_individual[NF-1:NCH];
+	if(pci_reset)
+	  fifo_reset_sysclock <= {NF{1'b1}};
 	else if(rx_wr_valid)
 	  case(rx_address)
 	    // set
-	    3: fifo_reset_sysclock <= fifo_reset_sysclock | rx_data[7:0];
+	    3: fifo_reset_sysclock <= fifo_reset_sysclock |
+				      {rx_data[32+NCH-1:32], rx_data[NCH-1:0]};
 	    // clear
-	    4: fifo_reset_sysclock <= fifo_reset_sysclock & ~rx_data[7:0];
+	    4: fifo_reset_sysclock <= fifo_reset_sysclock &
+				      ~{rx_data[32+NCH-1:32], rx_data[NCH-1:0]};
 	  endcase
 	if(tx_rc_ready)
 	  read_in_progress <= 1'b0;
@@ -140,100 +202,136 @@ module hififo_pcie
 	  tx_rc_valid <= 1'b1;
 
 	if(read[1])
-	  case(rx_rr_addr[4:1])
-	    0:  tx_rc_data <= interrupt_status;
-	    1:  tx_rc_data <= `ENABLE;
+	  case(rx_rr_qword)
+	    0:  tx_rc_data <= interrupt_fpc;
+	    1:  tx_rc_data <= EN[NCH-1:0];
 	    2:  tx_rc_data <= `BUILDTIME;
-	    3:  tx_rc_data <= fifo_reset_sysclock;
-	    4:  tx_rc_data <= fifo_reset_sysclock;
-	    8:  tx_rc_data <= status[0];
-	    9:  tx_rc_data <= status[1];
-	    10: tx_rc_data <= status[2];
-	    11: tx_rc_data <= status[3];
-	    12: tx_rc_data <= status[4];
-	    13: tx_rc_data <= status[5];
-	    14: tx_rc_data <= status[6];
-	    15: tx_rc_data <= status[7];
-	    default: tx_rc_data <= 1'b0;
+	    3:  tx_rc_data <= fifo_reset_sysclock[NCH-1:0];
+	    4:  tx_rc_data <= fifo_reset_sysclock[NF-1:NCH];
+	    5:  tx_rc_data <= EN[NF-1:NCH];
+	    6:  tx_rc_data <= interrupt_tpc;
+	    7:  tx_rc_data <= NCH;
+	    8:  tx_rc_data <= 8*W;
+	    9:  tx_rc_data <= {(FBITS > 3), cfg_dcommand[8]};
+	    default: tx_rc_data <=
+		     rx_rr_qword[6] ?
+		     ((rx_rr_qword[5:0] < NF) ? status[rx_rr_qword[5:0]] : 1'b0) :
+		     (rx_rr_qword[5:4] != 0) ? perf[rx_rr_qword[5:0]] : 1'b0;
 	  endcase
      end
 
    genvar i;
    generate
-      for (i = 0; i < 8; i = i+1) begin: fifo
-	 // i = 0 to 4: FPC FIFO
-	 if((2**i & `ENABLE & 8'h0F) != 0)
+      for (i = 0; i < NCH; i = i+1) begin: fpc
+	 if(EN[i])
 	   begin
-	      pcie_from_pc_fifo fpc_fifo
+	      wire [191:0] perf_i;
+
+	      pcie_from_pc_fifo
+		#(.TBITS(TBITS), .RBITS(`FPC_REQ_BITS - W + 1), .FBITS(FBITS),
+		  .W(W)) fpc_fifo
 		(.clock(clock),
 		 .reset(fifo_reset_sysclock[i]),
 		 .status(status[i]),
 		 .interrupt(interrupt_individual[i]),
-		 .fifo_number(i[1:0]),
+		 .fifo_number(i[FBITS-1:0]),
+		 .ext_tag(cfg_dcommand[8]),
+		 .mrrs(cfg_dcommand[14:12]),
 		 // read completion
 		 .rc_valid(rx_rc_valid),
 		 .rc_tag(rx_rc_tag),
 		 .rc_index(rx_rc_index),
-		 .pio_wvalid(rx_wr_valid && (rx_address == 8+i)),
+		 .rc_data(rx_rc_data),
+		 .pio_wvalid(rx_wr_valid && (rx_address == 64+i)),
 		 .rx_data(rx_data),
 		 // read request
 		 .rr_valid(mux_rr_valid[i]),
 		 .rr_ready(mux_rr_ready[i]),
-		 .rr_addr(mux_rr_addr[i]),
-		 .rr_tag(mux_rr_tag[i]),
+		 .rr_addr(mux_rr_addr[64*i+63:64*i]),
+		 .rr_tag(mux_rr_tag[8*i+7:8*i]),
+		 .rr_len(mux_rr_len[10*i+9:10*i]),
 		 // FIFO
 		 .fifo_clock(fifo_clock[i]),
 		 .fifo_read(fifo_rw[i] & ~fifo_reset[i]),
-		 .fifo_read_data(fifo_data[i]),
-		 .fifo_read_valid(fifo_ready[i])
+		 .fifo_read_data(fifo_fpc_data[64*W*i +: 64*W]),
+		 .fifo_read_valid(fifo_ready[i]),
+		 .perf_clear(perf_clear),
+		 .perf(perf_i)
 		 );
+
+	      if(i < 4)
+		assign fpc_perf[i] = perf_i;
 	   end
-	 else if(i<4)
+	 else
 	   begin
-	      assign mux_rr_tag[i] = 0;
-	      assign fifo_data[i] = 0;
+	      assign mux_rr_tag[8*i+7:8*i] = 0;
+	      assign mux_rr_len[10*i+9:10*i] = 0;
+	      assign fifo_fpc_data[64*W*i +: 64*W] = 0;
 	      assign mux_rr_valid[i] = 0;
-	      assign mux_rr_addr[i] = 0;
+	      assign mux_rr_addr[64*i+63:64*i] = 0;
+	      assign status[i] = 0;
+	      assign fifo_ready[i] = 0;
+	      assign interrupt_individual[i] = 0;
+	      if(i < 4)
+		assign fpc_perf[i] = 0;
 	   end
-	 // i = 4 to 7: TPC FIFO
-	 if((2**i & `ENABLE & 8'hF0) != 0)
+      end
+
+      for (i = 0; i < NCH; i = i+1) begin: tpc
+	 if(EN[NCH+i])
 	   begin
-	      hififo_tpc_fifo tpc_fifo
+	      wire [127:0] perf_i;
+
+	      hififo_tpc_fifo #(.W(W)) tpc_fifo
 		(.clock(clock),
-		 .reset(fifo_reset_sysclock[i]),
-		 .status(status[i]),
-		 .interrupt(interrupt_individual[i]),
+		 .reset(fifo_reset_sysclock[NCH+i]),
+		 .status(status[NCH+i]),
+		 .interrupt(interrupt_individual[NCH+i]),
 		 // write data
 		 .rx_data(rx_data),
-		 .rx_data_valid(rx_wr_valid && (rx_address == 8+i)),
+		 .rx_data_valid(rx_wr_valid && (rx_address == 64+NCH+i)),
 		 // write request to TX
-		 .wr_valid(mux_wr_valid[i-4]),
-		 .wr_ready(mux_wr_ready[i-4]),
-		 .wr_data(mux_wr_data[i-4]),
-		 .wr_addr(mux_wr_addr[i-4]),
-		 .wr_last(mux_wr_last[i-4]),
+		 .wr_valid(mux_wr_valid[i]),
+		 .wr_ready(mux_wr_ready[i]),
+		 .wr_data(mux_wr_data[64*W*i +: 64*W]),
+		 .wr_addr(mux_wr_addr[64*i+63:64*i]),
+		 .wr_last(mux_wr_last[i]),
+		 .wr_len(mux_wr_len[5*i+4:5*i]),
 		 // user FIFO
-		 .fifo_clock(fifo_clock[i]),
-		 .fifo_data(fifo_data[i]),
-		 .fifo_write(fifo_rw[i] & ~fifo_reset[i]),
-		 .fifo_ready(fifo_ready[i])
+		 .fifo_clock(fifo_clock[NCH+i]),
+		 .fifo_reset(fifo_reset[NCH+i]),
+		 .fifo_data(fifo_tpc_data[64*W*i +: 64*W]),
+		 .fifo_write(fifo_rw[NCH+i] & ~fifo_reset[NCH+i]),
+		 .fifo_ready(fifo_ready[NCH+i]),
+		 .perf_clear(perf_clear),
+		 .perf(perf_i)
 		 );
+
+	      if(i < 4)
+		assign tpc_perf[i] = perf_i;
 	   end
-	 else if(i>3)
-	   begin
-	      assign mux_wr_last[i-4] = 0;
-	      assign mux_wr_data[i-4] = 0;
-	      assign mux_wr_addr[i-4] = 0;
-	      assign mux_wr_valid[i-4] = 0;
-	   end
-	 if((2**i & `ENABLE) == 0)
+	 else
 	   begin
-	      assign status[i] = 0;
-	      assign fifo_ready[i] = 0;
-	      assign interrupt_individual[i] = 0;
-	      assign fifo_reset[i] = 1'b1;
+	      assign mux_wr_last[i] = 0;
+	      assign mux_wr_data[64*W*i +: 64*W] = 0;
+	      assign mux_wr_addr[64*i+63:64*i] = 0;
+	      assign mux_wr_len[5*i+4:5*i] = 0;
+	      assign mux_wr_valid[i] = 0;
+	      assign status[NCH+i] = 0;
+	      assign fifo_ready[NCH+i] = 0;
+	      assign interrupt_individual[NCH+i] = 0;
+	      if(i < 4)
+		assign tpc_perf[i] = 0;
 	   end
-	 else
+      end
+
+      for (i = NCH; i < 4; i = i+1) begin: perf_unused
+	 assign fpc_perf[i] = 0;
+	 assign tpc_perf[i] = 0;
+      end
+
+      for (i = 0; i < NF; i = i+1) begin: fifo_reset_sync
+	 if(EN[i])
 	   begin
 	      wire reset_sync_out;
 
@@ -250,20 +348,87 @@ module hififo_pcie
 		 .out(fifo_reset[i])
 		 );
 	   end
+	 else
+	   assign fifo_reset[i] = 1'b1;
       end
    endgenerate
 
    // AXI to core
    wire 	 s_axis_tx_tready;
-   wire [63:0] 	 s_axis_tx_tdata;
-   wire 	 s_axis_tx_1dw;
+   wire [`DBITS-1:0] s_axis_tx_tdata;
+   wire [`DBITS/32-1:0] s_axis_tx_keep; // DW enables
    wire 	 s_axis_tx_tlast;
    wire 	 s_axis_tx_tvalid;
    // AXI from core
    wire 	 m_axis_rx_tvalid;
    wire 	 m_axis_rx_tlast;
-   wire [63:0] 	 m_axis_rx_tdata;
+   wire [4:0] 	 m_axis_rx_sof, m_axis_rx_eof; // 128 bit only
+   wire [`DBITS-1:0] m_axis_rx_tdata;
+`ifdef DATA128
+   wire 	 rx_tlp_end = m_axis_rx_eof[4]; // TLPs may straddle beats
+`else
+   wire 	 rx_tlp_end = m_axis_rx_tlast;
+`endif
 
+   always @ (posedge clock)
+     begin
+	perf_clear <= pci_reset || (rx_wr_valid && (rx_address == 5));
+	if(perf_clear)
+	  begin
+	     perf_cycles <= 1'b0;
+	     perf_rx_busy <= 1'b0;
+	     perf_rx_tlps <= 1'b0;
+	  end
+	else
+	  begin
+	     perf_cycles <= perf_cycles + 1'b1;
+	     perf_rx_busy <= perf_rx_busy + m_axis_rx_tvalid;
+	     perf_rx_tlps <= perf_rx_tlps + (m_axis_rx_tvalid && rx_tlp_end);
+	  end
+     end
+
+   assign perf[16] = perf_cycles;
+   assign perf[17] = perf_tx_busy;
+   assign perf[18] = perf_tx_stall;
+   assign perf[19] = perf_tx_rc;
+   assign perf[20] = perf_tx_rr;
+   assign perf[21] = perf_tx_wr;
+   assign perf[22] = perf_rx_busy;
+   assign perf[23] = perf_rx_tlps;
+
+   genvar j;
+   generate
+      for (j = 0; j < 24; j = j+1) begin: perf_fpc
+	 assign perf[24+j] = fpc_perf[j/6][32*(j%6)+31:32*(j%6)];
+      end
+      for (j = 0; j < 16; j = j+1) begin: perf_tpc
+	 assign perf[48+j] = tpc_perf[j/4][32*(j%4)+31:32*(j%4)];
+      end
+   endgenerate
+
+`ifdef DATA128
+   pcie_rx128 rx
+     (.clock(clock),
+      .reset(pci_reset),
+      // outputs
+      .write_valid(rx_wr_valid),
+      .completion_valid(rx_rc_valid),
+      .completion_index(rx_rc_index),
+      .completion_tag(rx_rc_tag),
+      .completion_data(rx_rc_data),
+      .data(rx_data),
+      .address(rx_address),
+      .rr_valid(rx_rr_valid),
+      .rr_ready(rx_rr_ready),
+      .rr_rid_tag(rx_rr_rid_tag),
+      .rr_addr(rx_rr_addr),
+      // AXI stream from PCIE core
+      .tvalid(m_axis_rx_tvalid),
+      .sof(m_axis_rx_sof),
+      .eof(m_axis_rx_eof),
+      .tdata(m_axis_rx_tdata)
+      );
+`else
    pcie_rx rx
      (.clock(clock),
       .reset(pci_reset),
@@ -284,54 +449,90 @@ module hififo_pcie
       .tdata(m_axis_rx_tdata)
       );
 
+   assign rx_rc_data = rx_data;
+`endif
+
    wire 	 tx_rr_valid;
    wire 	 tx_rr_ready;
    wire [63:0] 	 tx_rr_addr;
    wire [7:0] 	 tx_rr_tag;
+   wire [9:0] 	 tx_rr_len;
 
-   rr_mux rr_mux
+   rr_mux #(.N(NCH)) rr_mux
      (.clock(clock),
       .reset(pci_reset),
-      .rri_valid(mux_rr_valid[3:0]),
-      .rri_ready(mux_rr_ready[3:0]),
-      .rri_addr_0(mux_rr_addr[0]),
-      .rri_addr_1(mux_rr_addr[1]),
-      .rri_addr_2(mux_rr_addr[2]),
-      .rri_addr_3(mux_rr_addr[3]),
-      .rri_tag_0(mux_rr_tag[0]),
-      .rri_tag_1(mux_rr_tag[1]),
-      .rri_tag_2(mux_rr_tag[2]),
-      .rri_tag_3(mux_rr_tag[3]),
+      .rri_valid(mux_rr_valid),
+      .rri_ready(mux_rr_ready),
+      .rri_addr(mux_rr_addr),
+      .rri_tag(mux_rr_tag),
+      .rri_len(mux_rr_len),
       .rro_valid(tx_rr_valid),
       .rro_ready(tx_rr_ready),
       .rro_addr(tx_rr_addr),
-      .rro_tag(tx_rr_tag));
+      .rro_tag(tx_rr_tag),
+      .rro_len(tx_rr_len));
 
    wire  	 tx_wr_valid, tx_wr_ready, tx_wr_last;
-   wire [63:0] 	 tx_wr_data;
+   wire [64*W-1:0] tx_wr_data;
    wire [63:0] 	 tx_wr_addr;
+   wire [4:0] 	 tx_wr_len;
 
-   wr_mux wr_mux
+   wr_mux #(.N(NCH), .DBITS(64*W)) wr_mux
      (.clock(clock),
       .reset(pci_reset),
       .wri_valid(mux_wr_valid),
       .wri_ready(mux_wr_ready),
       .wri_last(mux_wr_last),
-      .wri_addr_0(mux_wr_addr[0]),
-      .wri_addr_1(mux_wr_addr[1]),
-      .wri_addr_2(mux_wr_addr[2]),
-      .wri_addr_3(mux_wr_addr[3]),
-      .wri_data_0(mux_wr_data[0]),
-      .wri_data_1(mux_wr_data[1]),
-      .wri_data_2(mux_wr_data[2]),
-      .wri_data_3(mux_wr_data[3]),
+      .wri_addr(mux_wr_addr),
+      .wri_data(mux_wr_data),
+      .wri_len(mux_wr_len),
       .wro_valid(tx_wr_valid),
       .wro_ready(tx_wr_ready),
       .wro_addr(tx_wr_addr),
+      .wro_len(tx_wr_len),
       .wro_data(tx_wr_data),
       .wro_last(tx_wr_last)
      );
 
+`ifdef DATA128
+   pcie_tx128 tx
+     (.clock(clock),
+      .reset(pci_reset),
+      .pci_id(pci_id),
+      // read completion (rc)
+      .rc_valid(tx_rc_valid),
+      .rc_ready(tx_rc_ready),
+      .rc_dw2(tx_rc_dw2),
+      .rc_data(tx_rc_data),
+      // read request (rr)
+      .rr_valid(tx_rr_valid),
+      .rr_ready(tx_rr_ready),
+      .rr_addr(tx_rr_addr),
+      .rr_tag(tx_rr_tag),
+      .rr_len(tx_rr_len),
+      // write request (wr)
+      .wr_valid(tx_wr_valid),
+      .wr_ready(tx_wr_ready),
+      .wr_data(tx_wr_data),
+      .wr_addr(tx_wr_addr),
+      .wr_len(tx_wr_len),
+      // AXI stream to PCI Express core
+      .tx_tready(s_axis_tx_tready),
+      .tx_tdata(s_axis_tx_tdata),
+      .tx_keep(s_axis_tx_keep),
+      .tx_tlast(s_axis_tx_tlast),
+      .tx_tvalid(s_axis_tx_tvalid),
+      // performance counters
+      .perf_clear(perf_clear),
+      .perf_busy(perf_tx_busy),
+      .perf_stall(perf_tx_stall),
+      .perf_rc(perf_tx_rc),
+      .perf_rr(perf_tx_rr),
+      .perf_wr(perf_tx_wr)
+   );
+`else
+   wire 	 tx_1dw;
+
    pcie_tx tx
      (.clock(clock),
       .reset(pci_reset),
@@ -346,20 +547,32 @@ module hififo_pcie
       .rr_ready(tx_rr_ready),
       .rr_addr(tx_rr_addr),
       .rr_tag(tx_rr_tag),
+      .rr_len(tx_rr_len),
       // write request (wr)
       .wr_valid(tx_wr_valid),
       .wr_ready(tx_wr_ready),
       .wr_data(tx_wr_data),
       .wr_addr(tx_wr_addr),
+      .wr_len(tx_wr_len),
       .wr_last(tx_wr_last),
       // AXI stream to PCI Express core
       .tx_tready(s_axis_tx_tready),
       .tx_tdata(s_axis_tx_tdata),
-      .tx_1dw(s_axis_tx_1dw),
+      .tx_1dw(tx_1dw),
       .tx_tlast(s_axis_tx_tlast),
-      .tx_tvalid(s_axis_tx_tvalid)
+      .tx_tvalid(s_axis_tx_tvalid),
+      // performance counters
+      .perf_clear(perf_clear),
+      .perf_busy(perf_tx_busy),
+      .perf_stall(perf_tx_stall),
+      .perf_rc(perf_tx_rc),
+      .perf_rr(perf_tx_rr),
+      .perf_wr(perf_tx_wr)
    );
 
+   assign s_axis_tx_keep = {~tx_1dw, 1'b1};
+`endif
+
    pcie_core_wrap pcie_core_wrap
      (.pci_exp_txp(pci_exp_txp),
       .pci_exp_txn(pci_exp_txn),
@@ -370,6 +583,7 @@ module hififo_pcie
       .sys_rst_n(sys_rst_n),
       .clock(clock),
       .pci_id(pci_id),
+      .cfg_dcommand(cfg_dcommand),
       .interrupt(interrupt),
       .interrupt_rdy(interrupt_rdy),
       .pci_reset(pci_reset),
@@ -392,11 +606,13 @@ module hififo_pcie
    `endif
       .s_axis_tx_tready(s_axis_tx_tready),
       .s_axis_tx_tdata(s_axis_tx_tdata),
-      .s_axis_tx_1dw(s_axis_tx_1dw),
+      .s_axis_tx_keep(s_axis_tx_keep),
       .s_axis_tx_tlast(s_axis_tx_tlast),
       .s_axis_tx_tvalid(s_axis_tx_tvalid),
       .m_axis_rx_tvalid(m_axis_rx_tvalid),
       .m_axis_rx_tlast(m_axis_rx_tlast),
+      .m_axis_rx_sof(m_axis_rx_sof),
+      .m_axis_rx_eof(m_axis_rx_eof),
       .m_axis_rx_tdata(m_axis_rx_tdata)
       );
 
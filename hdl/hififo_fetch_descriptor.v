@@ -18,13 +18,28 @@
 
 `timescale 1ns/1ps
 
+/*
+ * Commands, wdata[2:0], pointers and counts in bytes:
+ * 1: interrupt when p_current reaches wdata[CMSB:BS]
+ * 2: stop at wdata[CMSB:BS]
+ * 3: base address, wdata[AMSB:CBITS]
+ * 4: abort, wdata[8]
+ * 5: interrupt moderation, threshold wdata[CMSB:BS], timer wdata[63:40]
+ *    cycles. An interrupt from 1 is held until p_current has moved
+ *    threshold bytes since the last interrupt, the timer has run out or
+ *    p_current has reached stop. 0, 0 is no moderation, as after reset.
+ * 6: to PC framing, see hififo_tpc_fifo.v and hififo_framer.v
+ */
+
 module hififo_fetch_descriptor
   (
    input 	   clock,
    input 	   reset,
    output [AMSB:0] request_addr,
    output 	   request_valid,
+   output [RBITS:0] request_len, // to the next 2**RBITS boundary or stop
    input 	   request_ack,
+   input [RBITS:0] request_step, // amount to advance on request_ack
    input [DMSB:0]  wdata,
    input 	   wvalid,
    output [SMSB:0] status,
@@ -37,19 +52,40 @@ module hififo_fetch_descriptor
    parameter SMSB = 31; // status MSB
    parameter CBITS = 22; // count bits
    parameter CMSB = CBITS - 1; // count MSB
+   parameter RBITS = 4; // requests do not cross 2**(RBITS+BS) byte boundaries
 
    reg [CMSB-BS:0]  p_current = 0, p_interrupt = 0, p_stop = 0;
    reg 		    reset_or_abort;
    reg 		    abort = 1;
    reg [AMSB-CBITS:0] addr_high;
+   reg 		    skipped = 0;
+   // interrupt moderation
+   reg [CMSB-BS:0]  mod_threshold = 0;
+   reg [23:0] 	    mod_timer = 0;
+   reg [CMSB-BS:0]  p_reported = 0; // p_current at the last interrupt
+   reg [23:0] 	    timer = 0;
+   reg 		    pending = 0;
+   wire 	    match;
+
+   wire [CMSB-BS:0] p_distance = p_stop - p_current;
+   wire [RBITS:0]   p_boundary = (1 << RBITS) - p_current[RBITS-1:0];
+   wire [CMSB-BS:0] p_to_interrupt = p_interrupt - p_current - 1'b1;
 
    wire write_interrupt = wvalid && (wdata[2:0] == 1);
    wire write_stop      = wvalid && (wdata[2:0] == 2);
    wire write_addr_high = wvalid && (wdata[2:0] == 3);
    wire write_abort     = wvalid && (wdata[2:0] == 4);
+   wire write_moderation = wvalid && (wdata[2:0] == 5);
+
+   wire [CMSB-BS:0] p_moved = p_current - p_reported;
+   assign interrupt = (match || pending) &&
+		      ((p_moved >= mod_threshold) || (p_current == p_stop) ||
+		       ((mod_timer != 0) && (timer >= mod_timer)));
 
    assign request_addr = {addr_high,p_current,{BS{1'b0}}};
    assign request_valid = (p_current != p_stop) && ~request_ack;
+   assign request_len = (p_distance < p_boundary) ?
+			p_distance[RBITS:0] : p_boundary;
    assign status = {p_current, {BS{1'b0}}};
 
    always @ (posedge clock)
@@ -68,12 +104,26 @@ module hififo_fetch_descriptor
 	if(write_interrupt)
 	  p_interrupt <= wdata[CMSB:BS];
 
-	p_current <= reset_or_abort ? 1'b0 : p_current + request_ack;
+	p_current <= reset_or_abort ? 1'b0 :
+		     p_current + (request_ack ? request_step : 1'b0);
+
+	// a step of more than one may jump over the interrupt point
+	skipped <= request_ack && (p_to_interrupt < request_step - 1'b1);
+
+	if(write_moderation)
+	  begin
+	     mod_threshold <= wdata[CMSB:BS];
+	     mod_timer <= wdata[63:40];
+	  end
+	pending <= ~reset_or_abort && (match || pending) && ~interrupt;
+	timer <= pending && ~interrupt ? timer + 1'b1 : 1'b0;
+	if(reset_or_abort || interrupt)
+	  p_reported <= reset_or_abort ? 1'b0 : p_current;
      end
 
    one_shot one_shot_i0
      (.clock(clock),
-      .in(p_current == p_interrupt),
-      .out(interrupt));
+      .in((p_current == p_interrupt) || skipped),
+      .out(match));
 
 endmodule
\ No newline at end of file
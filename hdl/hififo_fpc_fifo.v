@@ -24,87 +24,235 @@ module pcie_from_pc_fifo
    input 	 reset,
    output [31:0] status,
    output 	 interrupt,
-   input [1:0] 	 fifo_number,
-   // read completion
+   input [FBITS-1:0] fifo_number,
+   input 	 ext_tag, // extended tags enabled by the host
+   input [2:0] 	 mrrs, // max read request size, 128 << mrrs bytes
+   // register writes
    input [63:0]  rx_data,
-   input [7:0] 	 rc_tag,
-   input [5:0] 	 rc_index,
-   input 	 rc_valid,
    input 	 pio_wvalid,
+   // read completion, W qword lanes
+   input [64*W-1:0] rc_data,
+   input [7:0] 	 rc_tag,
+   input [9*W-1:0] rc_index,
+   input [W-1:0] rc_valid,
    // read request
    output reg 	 rr_valid, // RR is data fetch
    output [63:0] rr_addr,
    input 	 rr_ready,
-   output [2:0]  rr_tag,
+   output [7:0]  rr_tag,
+   output [9:0]  rr_len, // qwords
    // FIFO
    input 	 fifo_clock, // for all FIFO signals
    input 	 fifo_read,
-   output [63:0] fifo_read_data,
-   output 	 fifo_read_valid
+   output [64*W-1:0] fifo_read_data,
+   output 	 fifo_read_valid,
+   // performance counters, see hififo.v for the layout
+   input 	 perf_clear,
+   output [191:0] perf
    );
 
+   parameter TBITS = 3; // 2**TBITS tag slots, 2 to 6
+   parameter RBITS = 6; // 2**RBITS words per slot, 4 to 10 - W
+   parameter FBITS = 2; // FIFO number bits in the tag, 2 to 5
+   parameter W = 1; // qwords per FIFO word and completion lanes, 1 or 2
+   localparam SLOTS = 2**TBITS;
+   localparam ABITS = TBITS + RBITS;
+   localparam QBITS = RBITS + W - 1; // qword offset in a slot
+   localparam LBITS = 5 - FBITS; // slot bits below the FIFO number
+
    // FIFO
    reg [1:0] 	    rr_holdoff = 0;
-   reg [7:0] 	    block_filled = 0;
-   reg [8:0] 	    p_read;
-   reg [2:0] 	    p_write = 0; // 512 bytes
-   reg [2:0] 	    p_request = 0; // 512 byes
+   reg [SLOTS-1:0]  block_filled = 0;
+   reg [ABITS-1:0]  p_read; // slot, offset
+   reg [TBITS-1:0]  p_write = 0;
+   reg [TBITS-1:0]  p_request = 0;
    reg 		    fifo_write_0, fifo_write_1;
+   reg [RBITS:0]    slot_len[0:SLOTS-1]; // words requested into each slot
+   reg [9:0] 	    req_len = 0; // words
 
-   wire [63:0] 	    data_fifo_in_data;
+   wire [64*W-1:0]  data_fifo_in_data;
    wire 	    data_fifo_ready;
    wire 	    request_valid;
+   wire [RBITS:0]   request_len;
+   /*
+    * tag is {slot >> LBITS, fifo_number, slot[LBITS-1:0]}. Without
+    * extended tags only the slots below 2**LBITS are used, keeping tags
+    * below 32.
+    */
+   wire [TBITS-1:0] slot_mask = ((TBITS > LBITS) && ~ext_tag) ?
+		    (1 << LBITS) - 1 : SLOTS-1;
+   // fewer than 4 slots leaves none for requests, more than 8 FIFOs wait
+   // for extended tags and the driver refuses to load without them
+   wire 	    tags_ok = ext_tag || (LBITS >= 2) || (TBITS <= LBITS);
+   wire [TBITS-1:0] read_slot = p_read[ABITS-1:RBITS];
+   wire [7:0] 	    low_mask = (8'd1 << LBITS) - 1'b1;
+   wire [7:0] 	    request_slot = p_request;
+   wire [7:0] 	    request_fifo = fifo_number;
+   wire [7:0] 	    rc_slot_8 = ((rc_tag >> (LBITS + FBITS)) << LBITS) |
+		    (rc_tag & low_mask);
+   wire [7:0] 	    rc_fifo_8 = (rc_tag >> LBITS) &
+		    ((8'd1 << FBITS) - 1'b1);
+   wire [TBITS-1:0] rc_slot = rc_slot_8[TBITS-1:0];
+   wire [RBITS:0]   rc_len = slot_len[rc_slot];
+   wire [RBITS:0]   read_len = slot_len[read_slot];
+   wire 	    read_word = (read_slot != p_write) && data_fifo_ready;
+   wire [9:0] 	    mrrs_len = (10'd16 << ((mrrs > 5) ? 3'd5 : mrrs)) >> (W-1);
+   wire [RBITS:0]   max_len = (mrrs_len > 2**RBITS) ? 2**RBITS : mrrs_len;
 
    // write enables
    wire 	    rx_valid = pio_wvalid;
-   wire 	    write_reorder = (rc_tag[5:3] == fifo_number) && rc_valid;
-   wire 	    write_last = rc_valid
-		    && (rc_tag[5:3] == fifo_number) && (rc_index == 6'h3F);
-   wire [2:0] 	    n_requested = p_request - p_read[8:6];
-   wire 	    request_fifo_read = 0;
+   wire [W-1:0]     write_reorder = (rc_fifo_8 == fifo_number) ? rc_valid : 1'b0;
+   wire [QBITS-1:0] rc_start = rc_len << (W-1); // first qword offset - 0x200
+   reg 		    write_last;
+   wire [TBITS-1:0] n_requested = (p_request - read_slot) & slot_mask;
+
+   // performance counters
+   reg [15:0] 	    now = 0;
+   reg [15:0] 	    issued[0:SLOTS-1]; // time each tag slot was requested
+   reg [31:0] 	    perf_requests = 0;
+   reg [31:0] 	    perf_tag_stall = 0; // all tags outstanding
+   reg [31:0] 	    perf_full_stall = 0; // user logic not draining
+   reg [31:0] 	    perf_latency_sum = 0; // request to last completion
+   reg [31:0] 	    perf_latency_max = 0;
+   reg [15:0] 	    occupancy = 0; // words requested, not yet in the FIFO
+   reg [15:0] 	    occupancy_min = 16'hFFFF;
+   reg [15:0] 	    occupancy_max = 0;
+   wire [15:0] 	    latency = now - issued[rc_slot];
 
-   assign rr_tag = p_request[2:0];
+   assign perf = {occupancy_max, occupancy_min, perf_latency_max,
+		  perf_latency_sum, perf_full_stall, perf_tag_stall,
+		  perf_requests};
+
+   assign rr_len = req_len << (W-1);
+   assign rr_tag = ((request_slot >> LBITS) << (LBITS + FBITS)) |
+		   (request_fifo << LBITS) | (request_slot & low_mask);
 
    always @ (posedge clock)
      begin
 	rr_holdoff <= reset ? 1'b0 :
 		      rr_ready ? 2'd3 :
 		      rr_holdoff - (rr_holdoff != 0);
+	// a slot holds 1 to 2**RBITS qwords, starting at offset 0
 	p_read <= reset ? 1'b0 :
-		  p_read + ((p_read[8:6] != p_write[2:0]) && data_fifo_ready);
+		  ~read_word ? p_read :
+		  (p_read[RBITS-1:0] == read_len - 1'b1) ?
+		  {(read_slot + 1'b1) & slot_mask, {RBITS{1'b0}}} :
+		  p_read + 1'b1;
 	p_write <= reset ? 1'b0 :
-		   p_write + (block_filled[p_write[2:0]]);
+		   (p_write + block_filled[p_write]) & slot_mask;
 	p_request <= reset ? 1'b0 :
-		     p_request + (rr_ready && rr_valid);
-	fifo_write_0 <= ((p_read[8:6] != p_write[2:0]) && data_fifo_ready);
+		     (p_request + (rr_ready && rr_valid)) & slot_mask;
+	fifo_write_0 <= read_word;
 	fifo_write_1 <= fifo_write_0;
-	rr_valid <= request_valid && (n_requested < 6) && (rr_holdoff == 0);
+	// two slots of slack for the request pipeline
+	rr_valid <= request_valid && (n_requested < slot_mask - 1'b1)
+	  && (rr_holdoff == 0) && tags_ok;
+	// hold the length steady while the request is outstanding
+	if(~rr_valid)
+	  req_len <= (request_len > max_len) ? max_len : request_len;
+	if(rr_ready && rr_valid)
+	  slot_len[p_request] <= req_len;
+	// performance counters
+	now <= now + 1'b1;
+	if(rr_ready && rr_valid)
+	  issued[p_request] <= now;
+	occupancy <= reset ? 1'b0 : occupancy - read_word +
+		     ((rr_ready && rr_valid) ? req_len : 1'b0);
+	if(perf_clear)
+	  begin
+	     perf_requests <= 1'b0;
+	     perf_tag_stall <= 1'b0;
+	     perf_full_stall <= 1'b0;
+	     perf_latency_sum <= 1'b0;
+	     perf_latency_max <= 1'b0;
+	     occupancy_min <= 16'hFFFF;
+	     occupancy_max <= 1'b0;
+	  end
+	else
+	  begin
+	     perf_requests <= perf_requests + (rr_ready && rr_valid);
+	     perf_tag_stall <= perf_tag_stall +
+			       (request_valid && (n_requested >= slot_mask - 1'b1));
+	     perf_full_stall <= perf_full_stall +
+				((read_slot != p_write) && ~data_fifo_ready);
+	     if(write_last)
+	       begin
+		  perf_latency_sum <= perf_latency_sum + latency;
+		  if(latency > perf_latency_max)
+		    perf_latency_max <= latency;
+	       end
+	     if(~reset && (occupancy < occupancy_min))
+	       occupancy_min <= occupancy;
+	     if(~reset && (occupancy > occupancy_max))
+	       occupancy_max <= occupancy;
+	  end
      end
 
    genvar 	 i;
    generate
-      for (i = 0; i < 8; i = i+1) begin: block_fill
+      for (i = 0; i < SLOTS; i = i+1) begin: block_fill
          always @(posedge clock) begin
 	    if(reset)
 	      block_filled[i] <= 1'b0;
-	    else if(write_last && (rc_tag[2:0] == i))
+	    else if(write_last && (rc_slot == i))
 	      block_filled[i] <= 1'b1;
-	    else if(p_write[2:0] == i)
+	    else if(p_write == i)
 	      block_filled[i] <= 1'b0;
 	 end
       end
    endgenerate
 
-   block_ram #(.DBITS(64), .ABITS(9)) bram_reorder
-     (.clock(clock),
-      .w_data(rx_data),
-      .w_valid(write_reorder),
-      .w_addr({rc_tag[2:0],rc_index}),
-      .r_data(data_fifo_in_data),
-      .r_addr(p_read)
-      );
+   /*
+    * reorder buffer, a bank per qword of the word. Qword offset q of a
+    * slot is in bank q % W, so the two lanes of a clock, which are
+    * consecutive qwords, are always in different banks.
+    */
+   integer 	    l;
+   always @ (*)
+     begin
+	write_last = 1'b0;
+	for(l=0; l<W; l=l+1)
+	  if(write_reorder[l] && (&rc_index[9*l +: QBITS]))
+	    write_last = 1'b1;
+     end
+
+   generate
+      for (i = 0; i < W; i = i+1) begin: bank
+	 reg [63:0] 	  w_data;
+	 reg 		  w_valid;
+	 reg [RBITS-1:0]  w_offset;
+	 reg [QBITS-1:0]  q;
+	 integer 	  k;
+
+	 always @ (*)
+	   begin
+	      w_data = rc_data[63:0];
+	      w_valid = 1'b0;
+	      w_offset = 0;
+	      for(k=0; k<W; k=k+1)
+		begin
+		   q = rc_index[9*k +: QBITS] + rc_start;
+		   if(write_reorder[k] && ((q % W) == i))
+		     begin
+			w_data = rc_data[64*k +: 64];
+			w_valid = 1'b1;
+			w_offset = q / W;
+		     end
+		end
+	   end
+
+	 block_ram #(.DBITS(64), .ABITS(ABITS)) bram_reorder
+	   (.clock(clock),
+	    .w_data(w_data),
+	    .w_valid(w_valid),
+	    .w_addr({rc_slot, w_offset}),
+	    .r_data(data_fifo_in_data[64*i+63:64*i]),
+	    .r_addr(p_read)
+	    );
+      end
+   endgenerate
 
-   fwft_fifo #(.NBITS(64)) fpc_fifo
+   fwft_fifo #(.NBITS(64*W)) fpc_fifo
      (
       .reset(reset),
       .i_clock(clock),
@@ -118,12 +266,14 @@ module pcie_from_pc_fifo
       .o_almost_empty()
       );
 
-   hififo_fetch_descriptor #(.BS(9)) fetch_descriptor
+   hififo_fetch_descriptor #(.BS(2+W), .RBITS(RBITS)) fetch_descriptor
      (
       .clock(clock),
       .reset(reset),
       .request_addr(rr_addr),
+      .request_len(request_len),
       .request_ack(rr_ready),
+      .request_step(req_len[RBITS:0]),
       .request_valid(request_valid),
       .wvalid(rx_valid),
       .wdata(rx_data),
@@ -0,0 +1,143 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ *
+ * Frames a to PC stream on the user side of the FIFO, see user/Frame.h.
+ * Each frame is a 16 byte header, length FIFO words of user data and a
+ * FIFO word trailer:
+ * qword 0: [15:0] 16'h4648 ("HF"), [31:16] length, [63:32] sequence
+ * qword 1: fifo_clock cycle count at the first user word
+ * trailer: [31:0] CRC32C of the header and data, the rest 0
+ *
+ * The CRC is that of SSE4.2 crc32, reflected, initial value and final xor
+ * of ~0, over the qwords in order. enable and length are taken while
+ * reset is high, which also clears the sequence number. With enable low
+ * or length 0 the stream passes through.
+ */
+
+`timescale 1ns/1ps
+
+module hififo_framer
+  (
+   input 		 clock,
+   input 		 reset, // sync
+   input 		 enable,
+   input [15:0] 	 length,
+   // from user logic
+   input 		 i_write,
+   input [64*W-1:0] 	 i_data,
+   output 		 i_ready,
+   // to the FIFO
+   output reg 		 o_write = 0,
+   output reg [64*W-1:0] o_data = 0,
+   input 		 o_ready
+   );
+
+   parameter W = 1; // qwords per FIFO word, 1 or 2
+
+   localparam S_IDLE = 0, S_HEADER = 1, S_HOLD = 2, S_DATA = 3, S_TRAILER = 4;
+
+   function [31:0] crc32c;
+      input [31:0] crc;
+      input [64*W-1:0] d;
+      integer 	       i;
+      begin
+	 crc32c = crc;
+	 for(i=0; i<64*W; i=i+1)
+	   crc32c = (crc32c >> 1) ^ ((crc32c[0] ^ d[i]) ? 32'h82F63B78 : 32'h0);
+      end
+   endfunction
+
+   reg 			 en = 0;
+   reg [15:0] 		 len = 0;
+   reg [2:0] 		 state = S_IDLE;
+   reg 			 hword = 0; // header word, W = 1
+   reg [15:0] 		 count = 0; // data words left
+   reg [31:0] 		 seq = 0;
+   reg [31:0] 		 crc = 32'hFFFFFFFF;
+   reg [63:0] 		 cycles = 0;
+   reg [63:0] 		 stamp = 0;
+   reg [64*W-1:0] 	 hold = 0; // first user word, sent after the header
+
+   wire [127:0] 	 header = {stamp, seq, len, 16'h4648};
+   wire [64*W-1:0] 	 header_word = header >> (hword ? 64 : 0);
+   wire [64*W-1:0] 	 trailer = {{(64*W-32){1'b0}}, ~crc};
+   wire [64*W-1:0] 	 f_data = (state == S_HEADER) ? header_word :
+			 (state == S_HOLD) ? hold :
+			 (state == S_DATA) ? i_data : trailer;
+   wire 		 f_write = (state == S_DATA) ? i_write :
+			 (state != S_IDLE) && o_ready;
+
+   assign i_ready = o_ready &&
+		    (~en || (state == S_IDLE) || (state == S_DATA));
+
+   always @ (posedge clock)
+     begin
+	cycles <= cycles + 1'b1;
+	o_write <= ~reset && (en ? f_write : i_write);
+	o_data <= en ? f_data : i_data;
+	if(reset)
+	  begin
+	     en <= enable && (length != 0);
+	     len <= length;
+	     state <= S_IDLE;
+	     seq <= 1'b0;
+	     crc <= 32'hFFFFFFFF;
+	  end
+	else if(en)
+	  begin
+	     if(f_write)
+	       crc <= (state == S_TRAILER) ? 32'hFFFFFFFF : crc32c(crc, f_data);
+	     case(state)
+	       S_IDLE:
+		 if(i_write)
+		   begin
+		      hold <= i_data;
+		      stamp <= cycles;
+		      hword <= 1'b0;
+		      state <= S_HEADER;
+		   end
+	       S_HEADER:
+		 if(o_ready)
+		   begin
+		      hword <= 1'b1;
+		      if(hword || (W == 2))
+			state <= S_HOLD;
+		   end
+	       S_HOLD:
+		 if(o_ready)
+		   begin
+		      count <= len - 1'b1;
+		      state <= (len == 1) ? S_TRAILER : S_DATA;
+		   end
+	       S_DATA:
+		 if(i_write)
+		   begin
+		      count <= count - 1'b1;
+		      if(count == 1)
+			state <= S_TRAILER;
+		   end
+	       default:
+		 if(o_ready)
+		   begin
+		      seq <= seq + 1'b1;
+		      state <= S_IDLE;
+		   end
+	     endcase
+	  end
+     end
+
+endmodule
@@ -30,60 +30,146 @@ module hififo_tpc_fifo
    // to PCI TX
    output reg 	 wr_valid = 0,
    input 	 wr_ready,
-   output [63:0] wr_data,
+   output [64*W-1:0] wr_data,
    output [63:0] wr_addr,
    output reg 	 wr_last,
+   output reg [4:0] wr_len = 1, // FIFO words
    // FIFO
    input 	 fifo_clock,
+   input 	 fifo_reset, // sync to fifo_clock
    input 	 fifo_write,
-   input [63:0]  fifo_data,
-   output 	 fifo_ready
+   input [64*W-1:0] fifo_data,
+   output 	 fifo_ready,
+   // performance counters, see hififo.v for the layout
+   input 	 perf_clear,
+   output [127:0] perf
    );
 
+   parameter FLUSH = 32; // cycles to wait before sending a partial burst
+   parameter W = 1; // qwords per FIFO word, 1 or 2
+   localparam RBITS = 5 - W; // bursts of up to 128 bytes
+
    reg [4:0] 	 state = 0;
+   reg [7:0] 	 flush_count = 0;
+   // framing, command 6: wdata[8] enable, wdata[31:16] FIFO words per
+   // frame, taken by the framer at the next FIFO reset
+   reg 		 frame_enable = 0;
+   reg [15:0] 	 frame_length = 0;
+   wire 	 framed_write;
+   wire [64*W-1:0] framed_data;
+   wire 	 framer_ready;
 
-   wire 	 o_almost_empty;
+   wire 	 o_valid;
+   wire [64*W-1:0] o_data;
    wire 	 request_valid;
+   wire [4:0] 	 request_len;
+   wire 	 flush = flush_count == FLUSH;
    wire 	 fifo_read = (wr_ready && wr_valid)
 		 || ((state != 0) && (state < 30));
 
+   /*
+    * burst buffer, distributed RAM after the clock crossing FIFO, so the
+    * exact count is known and a flush can send all of a partial burst
+    */
+   reg [64*W-1:0] bbuf [0:31];
+   reg [5:0] 	 bb_in = 0, bb_out = 0;
+   wire [5:0] 	 bb_count = bb_in - bb_out;
+   wire 	 bb_fill = o_valid && (bb_count < 6'd31);
+   wire 	 bb_burst = bb_count >= request_len;
+
+   assign wr_data = bbuf[bb_out[4:0]];
+
+   // performance counters
+   reg [31:0] 	 perf_words = 0; // FIFO words sent
+   reg [31:0] 	 perf_grant_stall = 0; // waiting for the TX arbiter
+   reg [31:0] 	 perf_empty = 0; // host has room, no data from user logic
+   reg [31:0] 	 perf_host_stall = 0; // data waiting, host ring full
+
+   assign perf = {perf_host_stall, perf_empty, perf_grant_stall, perf_words};
+
    always @ (posedge clock)
      begin
 	if(reset)
 	  wr_valid <= 1'b0;
 	else
 	  wr_valid <= ((state == 0) || (state > 29))
-	    && request_valid && ~o_almost_empty;
-	wr_last <= state == 29;
+	    && request_valid && (bb_burst || ((bb_count != 0) && flush));
+	// less than a burst goes out as one shorter burst once the flush
+	// expires, the count only grows until the burst is read
+	if(~wr_valid)
+	  wr_len <= bb_burst ? request_len : bb_count[4:0];
+	flush_count <= ((bb_count != 0) && ~bb_burst && (state == 0)) ?
+		       flush_count + !flush : 1'b0;
+	if(bb_fill)
+	  bbuf[bb_in[4:0]] <= o_data;
+	bb_in <= reset ? 1'b0 : bb_in + bb_fill;
+	bb_out <= reset ? 1'b0 : bb_out + fifo_read;
+	wr_last <= (state == 29) || ((state == 0) && wr_ready && (wr_len == 1));
+	if(rx_data_valid && (rx_data[2:0] == 6))
+	  begin
+	     frame_enable <= rx_data[8];
+	     frame_length <= rx_data[31:16];
+	  end
 	if(reset)
 	  state <= 1'b0;
 	else if(state == 0)
-	  state <= wr_ready ? 5'd15 : 5'd0;
+	  state <= wr_ready ? 5'd31 - wr_len : 5'd0;
 	else
 	  state <= state + 1'b1;
+	if(perf_clear)
+	  begin
+	     perf_words <= 1'b0;
+	     perf_grant_stall <= 1'b0;
+	     perf_empty <= 1'b0;
+	     perf_host_stall <= 1'b0;
+	  end
+	else if(~reset)
+	  begin
+	     perf_words <= perf_words + fifo_read;
+	     perf_grant_stall <= perf_grant_stall + (wr_valid && ~wr_ready);
+	     perf_empty <= perf_empty + (request_valid && (bb_count == 0));
+	     perf_host_stall <= perf_host_stall +
+				((bb_count != 0) && ~request_valid);
+	  end
      end
 
-   fwft_fifo #(.NBITS(64)) data_fifo
+   hififo_framer #(.W(W)) framer
      (
-      .reset(reset),
-      .i_clock(fifo_clock),
+      .clock(fifo_clock),
+      .reset(fifo_reset),
+      .enable(frame_enable),
+      .length(frame_length),
+      .i_write(fifo_write),
       .i_data(fifo_data),
-      .i_valid(fifo_write),
       .i_ready(fifo_ready),
+      .o_write(framed_write),
+      .o_data(framed_data),
+      .o_ready(framer_ready)
+      );
+
+   fwft_fifo #(.NBITS(64*W)) data_fifo
+     (
+      .reset(reset),
+      .i_clock(fifo_clock),
+      .i_data(framed_data),
+      .i_valid(framed_write),
+      .i_ready(framer_ready),
       .o_clock(clock),
-      .o_read(fifo_read),
-      .o_data(wr_data),
-      .o_valid(),
-      .o_almost_empty(o_almost_empty)
+      .o_read(bb_fill),
+      .o_data(o_data),
+      .o_valid(o_valid),
+      .o_almost_empty()
       );
 
-    hififo_fetch_descriptor #(.BS(3)) fetch_descriptor
+    hififo_fetch_descriptor #(.BS(2+W), .RBITS(RBITS)) fetch_descriptor
      (
       .clock(clock),
       .reset(reset),
       .request_addr(wr_addr),
       .request_valid(request_valid),
+      .request_len(request_len),
       .request_ack(fifo_read),
+      .request_step(5'd1),
       .wvalid(rx_data_valid),
       .wdata(rx_data),
       .status(status),
@@ -25,10 +25,10 @@ module pcie_rx
    // outputs
    output reg 	     write_valid = 0,
    output reg 	     completion_valid = 0,
-   output reg [5:0]  completion_index = 0,
+   output reg [8:0]  completion_index = 0, // last qword of a request is 1FF
    output [7:0]      completion_tag,
    output reg [63:0] data = 0,
-   output [5:0]      address,
+   output [6:0]      address, // qwords
    output [23:0]     rr_rid_tag,
    output [7:0]      rr_addr,
    output 	     rr_valid,
@@ -46,7 +46,7 @@ module pcie_rx
 
    reg [12:0] 	     address_q = 0;
    assign completion_tag = address_q[12:5];
-   assign address = address_q[5:0];
+   assign address = address_q[6:0];
 
    reg 		     tvalid_q = 0;
    reg [63:0] 	     tdata_q = 0;
@@ -80,7 +80,7 @@ module pcie_rx
 	     if(wait_dw23)
 	       address_q <= tdata_q[15:3];
 	     if(wait_dw01)
-	       completion_index <= 6'h3F - {tdata_q[40:38],3'd0};
+	       completion_index <= 9'h1FF - tdata_q[43:35]; // byte count, qwords
 	     else if(wait_dw45)
 	       completion_index <= completion_index + 1'b1;
 	  end
@@ -109,4 +109,183 @@ module pcie_rx
       .o_almost_empty()
       );
 
-endmodule
\ No newline at end of file
+endmodule
+
+/*
+ * 128 bit variant. A TLP starts in DW0 or, straddling the end of the
+ * previous one, in DW2, as flagged by the core's is_sof and is_eof.
+ * Each beat is two 64 bit halves run through the pcie_rx state machine
+ * in turn, so completions deliver up to two qwords per clock, in lanes
+ * 0 and 1. Both lanes of a clock are from the same TLP.
+ */
+module pcie_rx128
+  (
+   input 	      clock,
+   input 	      reset,
+   // outputs
+   output reg 	      write_valid = 0,
+   output reg [63:0]  data = 0, // write data
+   output reg [6:0]   address = 0, // qwords
+   output reg [1:0]   completion_valid = 0, // per lane
+   output reg [17:0]  completion_index = 0, // lane 1 in 17:9
+   output reg [7:0]   completion_tag = 0,
+   output reg [127:0] completion_data = 0, // lane 1 in 127:64
+   output [23:0]      rr_rid_tag,
+   output [7:0]       rr_addr,
+   output 	      rr_valid,
+   input 	      rr_ready,
+   // AXI stream from PCIE core
+   input 	      tvalid,
+   input [4:0] 	      sof, // present, byte offset of the first DW
+   input [4:0] 	      eof, // present, byte offset of the last byte
+   input [127:0]      tdata
+   );
+
+   function [31:0] es; // endian swap
+      input [31:0]   x;
+      es = {x[7:0], x[15:8], x[23:16], x[31:24]};
+   endfunction
+
+   reg 		      tvalid_q = 0;
+   reg [127:0] 	      tdata_q = 0;
+   reg [4:0] 	      sof_q = 0;
+   reg [4:0] 	      eof_q = 0;
+   // state carried between halves, as pcie_rx
+   reg 		      in_tlp = 0; // the TLP continues in the next half
+   reg [2:0] 	      wait_q = 3'b001; // dw45, dw23, dw01
+   reg [31:0] 	      previous_dw = 0;
+   reg [12:0] 	      address_q = 0;
+   reg [8:0] 	      index_q = 0;
+   reg 		      is_write_32 = 0;
+   reg 		      is_cpld = 0;
+   reg 		      is_read_32_1dw = 0;
+   reg 		      rr_i_valid = 0;
+   reg [31:0] 	      rr_i_data = 0;
+
+   // the same after each half, the second half starts from the first
+   reg 		      n_in_tlp;
+   reg [2:0] 	      n_wait;
+   reg [31:0] 	      n_previous_dw;
+   reg [12:0] 	      n_address;
+   reg [8:0] 	      n_index;
+   reg 		      n_is_write_32, n_is_cpld, n_is_read_32_1dw;
+   reg 		      n_write_valid;
+   reg [63:0] 	      n_data;
+   reg [6:0] 	      n_write_address;
+   reg [1:0] 	      n_completion_valid;
+   reg [17:0] 	      n_completion_index;
+   reg [7:0] 	      n_completion_tag;
+   reg [127:0] 	      n_completion_data;
+   reg 		      n_rr_valid;
+   reg [31:0] 	      n_rr_data;
+   reg 		      h_valid, h_last;
+   reg [63:0] 	      h_q, h_data;
+   integer 	      h;
+
+   always @ (*)
+     begin
+	n_in_tlp = in_tlp;
+	n_wait = wait_q;
+	n_previous_dw = previous_dw;
+	n_address = address_q;
+	n_index = index_q;
+	n_is_write_32 = is_write_32;
+	n_is_cpld = is_cpld;
+	n_is_read_32_1dw = is_read_32_1dw;
+	n_write_valid = 1'b0;
+	n_data = data;
+	n_write_address = address;
+	n_completion_valid = 2'b00;
+	n_completion_index = completion_index;
+	n_completion_tag = completion_tag;
+	n_completion_data = completion_data;
+	n_rr_valid = 1'b0;
+	n_rr_data = rr_i_data;
+	for(h=0; h<2; h=h+1)
+	  begin
+	     h_q = tdata_q[64*h +: 64];
+	     // a new TLP starts in the low half only from sof DW0
+	     h_valid = tvalid_q && (n_in_tlp || (sof_q[4] && (sof_q[3] == h)));
+	     h_last = h_valid && eof_q[4] && (eof_q[3] == h);
+	     h_data = {es(h_q[31:0]), es(n_previous_dw)};
+	     if(h_valid)
+	       begin
+		  if(n_wait[0])
+		    begin
+		       n_is_write_32 = h_q[30:24] == 7'b1000000;
+		       n_is_cpld = h_q[30:24] == 7'b1001010;
+		       n_is_read_32_1dw = (h_q[30:24] == 7'b0000000)
+			 && (h_q[9:0] == 10'd1);
+		       n_index = 9'h1FF - h_q[43:35]; // byte count, qwords
+		    end
+		  if(n_wait[1])
+		    begin
+		       n_address = h_q[15:3];
+		       // RID (16), tag (8), addr[9:2]
+		       n_rr_valid = n_is_read_32_1dw;
+		       n_rr_data = {n_previous_dw[31:8], h_q[9:2]};
+		    end
+		  if(n_wait[2])
+		    begin
+		       n_index = n_index + 1'b1;
+		       if(n_is_write_32)
+			 begin
+			    n_write_valid = 1'b1;
+			    n_data = h_data;
+			    n_write_address = n_address[6:0];
+			 end
+		       if(n_is_cpld)
+			 begin
+			    n_completion_valid[h] = 1'b1;
+			    n_completion_index[9*h +: 9] = n_index;
+			    n_completion_data[64*h +: 64] = h_data;
+			    n_completion_tag = n_address[12:5];
+			 end
+		    end
+		  n_previous_dw = h_q[63:32];
+		  n_in_tlp = ~h_last;
+		  n_wait = h_last ? 3'b001 : n_wait[0] ? 3'b010 : 3'b100;
+	       end
+	  end
+     end
+
+   always @ (posedge clock)
+     begin
+	tvalid_q <= tvalid;
+	tdata_q <= tdata;
+	sof_q <= sof;
+	eof_q <= eof;
+	in_tlp <= reset ? 1'b0 : n_in_tlp;
+	wait_q <= reset ? 3'b001 : n_wait;
+	previous_dw <= n_previous_dw;
+	address_q <= n_address;
+	index_q <= n_index;
+	is_write_32 <= n_is_write_32;
+	is_cpld <= n_is_cpld;
+	is_read_32_1dw <= n_is_read_32_1dw;
+	write_valid <= n_write_valid && ~reset;
+	data <= n_data;
+	address <= n_write_address;
+	completion_valid <= reset ? 2'b00 : n_completion_valid;
+	completion_index <= n_completion_index;
+	completion_tag <= n_completion_tag;
+	completion_data <= n_completion_data;
+	rr_i_valid <= n_rr_valid && ~reset;
+	rr_i_data <= n_rr_data;
+     end
+
+   fwft_fifo #(.NBITS(32)) read_fifo
+     (
+      .reset(reset),
+      .i_clock(clock),
+      .i_data(rr_i_data),
+      .i_valid(rr_i_valid),
+      .i_ready(),
+      .o_clock(clock),
+      .o_read(rr_ready),
+      .o_data({rr_rid_tag, rr_addr}),
+      .o_valid(rr_valid),
+      .o_almost_empty()
+      );
+
+endmodule
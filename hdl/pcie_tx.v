@@ -33,18 +33,27 @@ module pcie_tx
    output reg 	 rr_ready,
    input [63:0]  rr_addr,
    input [7:0] 	 rr_tag,
+   input [9:0] 	 rr_len, // qwords, 1 to 512
    // write request (wr)
    input 	 wr_valid,
-   output  	 wr_ready, // pulses 16 times in request of the next data value
+   output  	 wr_ready, // pulses once at the start of each burst
    input [63:0]  wr_data,
    input [63:0]  wr_addr,
+   input [4:0] 	 wr_len, // qwords, 1 to 16
    input 	 wr_last,
    // AXI stream to PCI Express core
    input 	 tx_tready,
    output [63:0] tx_tdata,
    output 	 tx_1dw,
    output 	 tx_tlast,
-   output 	 tx_tvalid
+   output 	 tx_tvalid,
+   // performance counters, free running
+   input 	 perf_clear,
+   output reg [31:0] perf_busy = 0, // cycles a word was accepted by the core
+   output reg [31:0] perf_stall = 0, // cycles the core held off a word
+   output reg [31:0] perf_rc = 0, // TLPs sent by type
+   output reg [31:0] perf_rr = 0,
+   output reg [31:0] perf_wr = 0
    );
 
    function [31:0] es; // endian swap
@@ -95,14 +104,14 @@ module pcie_tx
 	  2: fi_data <= {2'b01, es(rc_data), rc_dw2};
 	  // read request (rr)
 	  3: fi_data <= {2'b00, {pci_id, rr_tag[7:0], 8'hFF},
-			 {2'd0, ~rr_is_32, 29'd128}};
+			 {2'd0, ~rr_is_32, 19'd0, rr_len[8:0], 1'b0}};
 	  4: fi_data <= {rr_is_32_q, 1'b1, rr_addr[31:0],
 			 rr_is_32_q ? rr_addr[31:0] : rr_addr[63:32]};
 	  // write request (wr)
 	  5: begin
 	     wr_is_32 <= wr_addr[63:32] == 0;
 	     fi_data <= {2'b00, pci_id, 16'h00FF, 2'b01, wr_addr[63:32] != 0,
-			 23'd0, 5'd16, 1'b0};
+			 23'd0, wr_len, 1'b0};
 	  end
 	  6: begin
 	     fi_data <= {2'b00, wr_is_32 ?
@@ -124,6 +133,22 @@ module pcie_tx
 	rr_ready <= (state == 3);
 	rr_is_32_q <= rr_is_32;
 	rc_ready <= (state == 1);
+	if(reset || perf_clear)
+	  begin
+	     perf_busy <= 1'b0;
+	     perf_stall <= 1'b0;
+	     perf_rc <= 1'b0;
+	     perf_rr <= 1'b0;
+	     perf_wr <= 1'b0;
+	  end
+	else
+	  begin
+	     perf_busy <= perf_busy + (tx_tvalid && tx_tready);
+	     perf_stall <= perf_stall + (tx_tvalid && ~tx_tready);
+	     perf_rc <= perf_rc + (state == 1);
+	     perf_rr <= perf_rr + (state == 3);
+	     perf_wr <= perf_wr + (state == 5);
+	  end
      end
 
    fwft_fifo #(.NBITS(66), .FULL_OFFSET(9'h1C0)) tx_fifo
@@ -142,194 +167,332 @@ module pcie_tx
 
 endmodule
 
-module rr_mux4
+/*
+ * 128 bit variant of pcie_tx. TLPs start in DW0 of a beat, tx_keep has
+ * a bit per DW of the last beat. Write data is 16 byte words, the first
+ * word is on wr_data the clock after wr_ready.
+ */
+module pcie_tx128
+  (
+   input 	     clock,
+   input 	     reset,
+   input [15:0]      pci_id,
+   // read completion (rc)
+   input [31:0]      rc_dw2,
+   input [31:0]      rc_data,
+   input 	     rc_valid,
+   output reg 	     rc_ready,
+   // read request (rr)
+   input 	     rr_valid,
+   output reg 	     rr_ready,
+   input [63:0]      rr_addr,
+   input [7:0] 	     rr_tag,
+   input [9:0] 	     rr_len, // qwords, 1 to 512
+   // write request (wr)
+   input 	     wr_valid,
+   output 	     wr_ready, // pulses once at the start of each burst
+   input [127:0]     wr_data,
+   input [63:0]      wr_addr,
+   input [4:0] 	     wr_len, // 16 byte words, 1 to 16
+   // AXI stream to PCI Express core
+   input 	     tx_tready,
+   output [127:0]    tx_tdata,
+   output [3:0]      tx_keep,
+   output 	     tx_tlast,
+   output 	     tx_tvalid,
+   // performance counters, free running
+   input 	     perf_clear,
+   output reg [31:0] perf_busy = 0, // cycles a word was accepted by the core
+   output reg [31:0] perf_stall = 0, // cycles the core held off a word
+   output reg [31:0] perf_rc = 0, // TLPs sent by type
+   output reg [31:0] perf_rr = 0,
+   output reg [31:0] perf_wr = 0
+   );
+
+   function [31:0] es; // endian swap
+      input [31:0]   x;
+      es = {x[7:0], x[15:8], x[23:16], x[31:24]};
+   endfunction
+
+   function [127:0] es4; // endian swap each DW
+      input [127:0]  x;
+      es4 = {es(x[127:96]), es(x[95:64]), es(x[63:32]), es(x[31:0])};
+   endfunction
+
+   reg [2:0] 	     state = 0;
+   // FIFO input
+   wire 	     fi_ready;
+   reg [132:0] 	     fi_data; // keep, last, data
+   reg 		     fi_valid = 0;
+   // wr
+   reg [127:0] 	     wr_data_prev;
+   reg 		     wr_is_32 = 0;
+   reg 		     wr_first = 0;
+   reg [4:0] 	     wr_count = 0; // words still to take from wr_data
+   reg [63:0] 	     wr_header; // DW1, DW0
+   reg [31:0] 	     wr_addr_32;
+   wire 	     wr_addr_is_32 = wr_addr[63:32] == 0;
+   // rr
+   wire 	     rr_is_32 = rr_addr[63:32] == 0;
+
+   wire [2:0] 	     next = ~fi_ready ? 3'd0 :
+		     rc_valid ? 3'd1 :
+		     rr_valid ? 3'd3 :
+		     wr_valid ? 3'd5 : 3'd0;
+
+   assign wr_ready = (state == 5);
+
+   always @(posedge clock)
+     begin
+	if(reset)
+	  state <= 3'd0;
+	else
+	  case(state)
+	    default: state <= next;
+	    1: state <= 3'd2;
+	    2: state <= 3'd0;
+	    3: state <= 3'd4;
+	    4: state <= 3'd0;
+	    5: state <= 3'd6;
+	    // a 3 DW header pushes the last DWs into another beat
+	    6: state <= (wr_count != 1) ? 3'd6 : wr_is_32 ? 3'd7 : next;
+	    7: state <= next;
+	  endcase
+	fi_valid <= (state == 1) || (state == 3) ||
+		    ((state == 5) && ~wr_addr_is_32) ||
+		    (state == 6) || (state == 7);
+	case(state)
+	  // read completion (rc), always 1 DW
+	  1: fi_data <= {4'hF, 1'b1, es(rc_data), rc_dw2,
+			 pci_id, 16'd4, 32'h4A000001};
+	  // read request (rr)
+	  3: fi_data <= {rr_is_32 ? 4'h7 : 4'hF, 1'b1,
+			 rr_is_32 ? {32'd0, rr_addr[31:0]} :
+			 {rr_addr[31:0], rr_addr[63:32]},
+			 {pci_id, rr_tag[7:0], 8'hFF},
+			 {2'd0, ~rr_is_32, 19'd0, rr_len[8:0], 1'b0}};
+	  // write request (wr), the header alone with a 64 bit address
+	  5: fi_data <= {4'hF, 1'b0, wr_addr[31:0], wr_addr[63:32],
+			 pci_id, 16'h00FF,
+			 2'b01, 1'b1, 22'd0, wr_len, 2'b00};
+	  6: fi_data <= ~wr_is_32 ? {4'hF, wr_count == 1, es4(wr_data)} :
+			wr_first ? {4'hF, 1'b0, es(wr_data[31:0]),
+				    wr_addr_32, wr_header} :
+			{4'hF, 1'b0, es(wr_data[31:0]),
+			 es(wr_data_prev[127:96]), es(wr_data_prev[95:64]),
+			 es(wr_data_prev[63:32])};
+	  7: fi_data <= {4'h7, 1'b1, 32'd0,
+			 es(wr_data_prev[127:96]), es(wr_data_prev[95:64]),
+			 es(wr_data_prev[63:32])};
+	  default: fi_data <= 1'b0;
+	endcase
+	if(state == 5)
+	  begin
+	     wr_is_32 <= wr_addr_is_32;
+	     wr_header <= {pci_id, 16'h00FF,
+			   2'b01, ~wr_addr_is_32, 22'd0, wr_len, 2'b00};
+	     wr_addr_32 <= wr_addr[31:0];
+	  end
+	wr_first <= (state == 5);
+	wr_count <= (state == 5) ? wr_len : wr_count - (state == 6);
+	wr_data_prev <= wr_data;
+	rr_ready <= (state == 3);
+	rc_ready <= (state == 1);
+	if(reset || perf_clear)
+	  begin
+	     perf_busy <= 1'b0;
+	     perf_stall <= 1'b0;
+	     perf_rc <= 1'b0;
+	     perf_rr <= 1'b0;
+	     perf_wr <= 1'b0;
+	  end
+	else
+	  begin
+	     perf_busy <= perf_busy + (tx_tvalid && tx_tready);
+	     perf_stall <= perf_stall + (tx_tvalid && ~tx_tready);
+	     perf_rc <= perf_rc + (state == 1);
+	     perf_rr <= perf_rr + (state == 3);
+	     perf_wr <= perf_wr + (state == 5);
+	  end
+     end
+
+   fwft_fifo #(.NBITS(133), .FULL_OFFSET(9'h1C0)) tx_fifo
+     (
+      .reset(reset),
+      .i_clock(clock),
+      .i_data(fi_data),
+      .i_valid(fi_valid),
+      .i_ready(fi_ready),
+      .o_clock(clock),
+      .o_read(tx_tready & tx_tvalid),
+      .o_data({tx_keep, tx_tlast, tx_tdata}),
+      .o_valid(tx_tvalid),
+      .o_almost_empty()
+      );
+
+endmodule
+
+/*
+ * Round robin arbiter for read requests from N FPC FIFOs. The next
+ * request is taken from the first valid input after the last one served.
+ */
+module rr_mux
   (
    input 		clock,
    input 		reset,
-   input [3:0] 		rri_valid,
-   output [3:0] 	rri_ready,
-   input [63:0] 	rri_addr_0,
-   input [63:0] 	rri_addr_1,
-   input [63:0] 	rri_addr_2,
-   input [63:0] 	rri_addr_3,
-   input [TAG-1:0] 	rri_tag_0,
-   input [TAG-1:0] 	rri_tag_1,
-   input [TAG-1:0] 	rri_tag_2,
-   input [TAG-1:0] 	rri_tag_3,
+   input [N-1:0] 	rri_valid,
+   output [N-1:0] 	rri_ready,
+   input [64*N-1:0] 	rri_addr,
+   input [8*N-1:0] 	rri_tag,
+   input [10*N-1:0] 	rri_len,
    output reg 		rro_valid = 0,
    input 		rro_ready,
    output [63:0] 	rro_addr,
-   output reg [TAG-1:0] rro_tag
+   output reg [7:0] 	rro_tag = 0,
+   output reg [9:0] 	rro_len = 0
    );
-   parameter TAG = 8;
-   parameter AMIN = 0; // lowest address bit to keep
-   reg [3:0] 		state = 0;
-   reg [63-AMIN:0] 	rro_addr_s;
-   assign rro_addr[63:AMIN] = rro_addr_s;
-   assign rro_addr[AMIN-1:0] = 0;
+
+   parameter N = 4; // 1 to 32
+   localparam IBITS = (N > 1) ? $clog2(N) : 1;
+
+   reg [1:0] 		state = 0;
+   reg [IBITS-1:0] 	sel = 0;
+   reg [60:0] 		rro_addr_s = 0;
+   reg [IBITS-1:0] 	next;
+   reg 			next_valid;
+   integer 		k, n;
+
+   assign rro_addr = {rro_addr_s, 3'd0};
+
+   // the input after sel has priority, sel itself is last
+   always @ (*)
+     begin
+	next = sel;
+	next_valid = 1'b0;
+	for(k=N; k>0; k=k-1)
+	  begin
+	     n = sel + k;
+	     if(n >= N)
+	       n = n - N;
+	     if(rri_valid[n])
+	       begin
+		  next = n;
+		  next_valid = 1'b1;
+	       end
+	  end
+     end
+
+   genvar 		i;
+   generate
+      for (i = 0; i < N; i = i+1) begin: ready
+	 assign rri_ready[i] = (state == 2) && (sel == i);
+      end
+   endgenerate
 
    always @ (posedge clock)
      begin
 	if(reset)
-	  state <= 4'h0;
+	  state <= 2'd0;
 	else
-	  begin
-	     casex(state)
-	       4'h0: state <= state + (rri_valid[0] ? 4'd1 : 4'd4);
-	       4'h4: state <= state + (rri_valid[1] ? 4'd1 : 4'd4);
-	       4'h8: state <= state + (rri_valid[2] ? 4'd1 : 4'd4);
-	       4'hC: state <= state + (rri_valid[3] ? 4'd1 : 4'd4);
-	       4'bxx01: state <= state + rro_ready;
-	       default: state <= state + 1'b1;
-	     endcase
-	  end
-	rro_valid <= (state[1:0] == 1) && ~rro_ready;
-	case(state[3:2])
-	  0: rro_addr_s <= rri_addr_0[63:AMIN];
-	  1: rro_addr_s <= rri_addr_1[63:AMIN];
-	  2: rro_addr_s <= rri_addr_2[63:AMIN];
-	  3: rro_addr_s <= rri_addr_3[63:AMIN];
-	endcase
-	case(state[3:2])
-	  0: rro_tag <= rri_tag_0;
-	  1: rro_tag <= rri_tag_1;
-	  2: rro_tag <= rri_tag_2;
-	  3: rro_tag <= rri_tag_3;
-	endcase
+	  case(state)
+	    0: if(next_valid)
+	      begin
+		 sel <= next;
+		 state <= 2'd1;
+	      end
+	    1: state <= rro_ready ? 2'd2 : 2'd1;
+	    2: state <= 2'd3; // rri_ready
+	    3: state <= 2'd0; // the request valid is registered
+	  endcase
+	rro_valid <= (state == 1) && ~rro_ready;
+	rro_addr_s <= rri_addr[64*sel+3 +: 61];
+	rro_tag <= rri_tag[8*sel +: 8];
+	rro_len <= rri_len[10*sel +: 10];
      end
-   assign rri_ready[0] = state == 2;
-   assign rri_ready[1] = state == 6;
-   assign rri_ready[2] = state == 10;
-   assign rri_ready[3] = state == 14;
 endmodule
 
+/*
+ * Round robin arbiter for write bursts from N TPC FIFOs. An input keeps
+ * the output from wro_ready until wri_last.
+ */
 module wr_mux
   (
    input 	     clock,
    input 	     reset,
-   input [3:0] 	     wri_valid,
-   output [3:0]      wri_ready,
-   input [3:0] 	     wri_last,
-   input [63:0]      wri_addr_0,
-   input [63:0]      wri_addr_1,
-   input [63:0]      wri_addr_2,
-   input [63:0]      wri_addr_3,
-   input [63:0]      wri_data_0,
-   input [63:0]      wri_data_1,
-   input [63:0]      wri_data_2,
-   input [63:0]      wri_data_3,
+   input [N-1:0]     wri_valid,
+   output [N-1:0]    wri_ready,
+   input [N-1:0]     wri_last,
+   input [64*N-1:0]  wri_addr,
+   input [DBITS*N-1:0] wri_data,
+   input [5*N-1:0]   wri_len,
    output 	     wro_valid,
    input 	     wro_ready,
    output [63:0]     wro_addr,
-   output reg [63:0] wro_data,
+   output reg [4:0]  wro_len = 0,
+   output reg [DBITS-1:0] wro_data,
    output reg 	     wro_last
    );
 
-   reg [3:0] 	     state = 0;
+   parameter N = 4; // 1 to 32
+   parameter DBITS = 64;
+   localparam IBITS = (N > 1) ? $clog2(N) : 1;
+
+   reg [1:0] 	     state = 0;
+   reg [IBITS-1:0]   sel = 0;
    reg [60:0] 	     wro_addr_s = 0;
+   reg [IBITS-1:0]   next;
+   reg 		     next_valid;
+   integer 	     k, n;
 
    assign wro_addr = {wro_addr_s, 3'd0};
-   assign wri_ready[0] = (state == 1) && wro_ready;
-   assign wri_ready[1] = (state == 5) && wro_ready;
-   assign wri_ready[2] = (state == 9) && wro_ready;
-   assign wri_ready[3] = (state == 13) && wro_ready;
-   assign wro_valid = (state[1:0] == 1);
-   always @ (posedge clock)
+   assign wro_valid = (state == 1);
+
+   // the input after sel has priority, sel itself is last
+   always @ (*)
      begin
-	if(reset)
-	  state <= 4'h0;
-	else
+	next = sel;
+	next_valid = 1'b0;
+	for(k=N; k>0; k=k-1)
 	  begin
-	     casex(state)
-	       default: state <= wri_valid[0] ? 4'h1 :
-				 wri_valid[1] ? 4'h5 :
-				 wri_valid[2] ? 4'h9 :
-				 wri_valid[3] ? 4'hD : 4'h0;
-	       4'bxx01: state <= state + wro_ready;
-	       4'h2: state <= ~wri_last[0] ? state :
-			      wri_valid[1] ? 4'h5 :
-			      wri_valid[2] ? 4'h9 :
-			      wri_valid[3] ? 4'hD :
-			      wri_valid[0] ? 4'h1 : 4'h0;
-	       4'h6: state <= ~wri_last[1] ? state :
-			      wri_valid[0] ? 4'h1 :
-			      wri_valid[2] ? 4'h9 :
-			      wri_valid[3] ? 4'hD :
-			      wri_valid[1] ? 4'h5 : 4'h0;
-	       4'hA: state <= ~wri_last[2] ? state :
-			      wri_valid[3] ? 4'hD :
-			      wri_valid[0] ? 4'h1 :
-			      wri_valid[1] ? 4'h5 :
-			      wri_valid[2] ? 4'h9 : 4'h0;
-	       4'hE: state <= ~wri_last[3] ? state :
-			      wri_valid[0] ? 4'h1 :
-			      wri_valid[1] ? 4'h5 :
-			      wri_valid[2] ? 4'h9 :
-			      wri_valid[3] ? 4'hD : 4'h0;
-	     endcase
+	     n = sel + k;
+	     if(n >= N)
+	       n = n - N;
+	     if(wri_valid[n])
+	       begin
+		  next = n;
+		  next_valid = 1'b1;
+	       end
 	  end
-	case(state[3:2])
-	  0: wro_addr_s <= wri_addr_0[63:3];
-	  1: wro_addr_s <= wri_addr_1[63:3];
-	  2: wro_addr_s <= wri_addr_2[63:3];
-	  3: wro_addr_s <= wri_addr_3[63:3];
-	endcase
-	case(state[3:2])
-	  0: wro_data <= wri_data_0;
-	  1: wro_data <= wri_data_1;
-	  2: wro_data <= wri_data_2;
-	  3: wro_data <= wri_data_3;
-	endcase
-	case(state[3:2])
-	  0: wro_last <= wri_last[0];
-	  1: wro_last <= wri_last[1];
-	  2: wro_last <= wri_last[2];
-	  3: wro_last <= wri_last[3];
-	endcase
      end
-endmodule
-
-module rr_mux
-  (
-   input 	 clock,
-   input 	 reset,
-   input [3:0] 	 rri_valid,
-   output [3:0]  rri_ready,
-   input [63:0]  rri_addr_0,
-   input [63:0]  rri_addr_1,
-   input [63:0]  rri_addr_2,
-   input [63:0]  rri_addr_3,
-   input [2:0] 	 rri_tag_0,
-   input [2:0] 	 rri_tag_1,
-   input [2:0] 	 rri_tag_2,
-   input [2:0] 	 rri_tag_3,
-   output 	 rro_valid,
-   input 	 rro_ready,
-   output [63:0] rro_addr,
-   output [7:0]  rro_tag
-   );
 
-   wire [4:0] 	 rro_tag_raw;
-   assign rro_tag = {3'b0, rro_tag_raw};
-
-   rr_mux4 #(.TAG(5), .AMIN(9)) rr_mux4_0
-     (.clock(clock),
-      .reset(reset),
-      .rri_valid(rri_valid[3:0]),
-      .rri_ready(rri_ready[3:0]),
-      .rri_addr_0(rri_addr_0),
-      .rri_addr_1(rri_addr_1),
-      .rri_addr_2(rri_addr_2),
-      .rri_addr_3(rri_addr_3),
-      .rri_tag_0({2'd0,rri_tag_0}),
-      .rri_tag_1({2'd1,rri_tag_1}),
-      .rri_tag_2({2'd2,rri_tag_2}),
-      .rri_tag_3({2'd3,rri_tag_3}),
-      .rro_valid(rro_valid),
-      .rro_ready(rro_ready),
-      .rro_addr(rro_addr),
-      .rro_tag(rro_tag_raw)
-      );
+   genvar 	     i;
+   generate
+      for (i = 0; i < N; i = i+1) begin: ready
+	 assign wri_ready[i] = (state == 1) && (sel == i) && wro_ready;
+      end
+   endgenerate
 
+   always @ (posedge clock)
+     begin
+	if(reset)
+	  state <= 2'd0;
+	else
+	  case(state)
+	    1: state <= wro_ready ? 2'd2 : 2'd1;
+	    2: if(wri_last[sel])
+	      begin
+		 sel <= next;
+		 state <= next_valid ? 2'd1 : 2'd0;
+	      end
+	    default: if(next_valid)
+	      begin
+		 sel <= next;
+		 state <= 2'd1;
+	      end
+	  endcase
+	wro_addr_s <= wri_addr[64*sel+3 +: 61];
+	wro_len <= wri_len[5*sel +: 5];
+	wro_data <= wri_data[DBITS*sel +: DBITS];
+	wro_last <= wri_last[sel];
+     end
 endmodule
-
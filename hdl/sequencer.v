@@ -49,6 +49,21 @@
  *           mode = 0: unconditional wait
  *           mode = 2: wait for status bit to be clear
  *           mode = 3: wait for status btt to be set
+ *
+ * extended instructions, fpc_data[63:62] = 0, op in fpc_data[61:56]:
+ * LOAD:  op = 1, the next fpc_data[47:32] words are stored to program
+ *        memory starting at fpc_data[PBITS-1:0]
+ * RUN:   op = 2, execute from program memory at fpc_data[PBITS-1:0]
+ * LOOP:  op = 3, jump to fpc_data[PBITS-1:0] until the loop body has run
+ *        fpc_data[47:32] times, 0 = forever. One level, no nesting.
+ * HALT:  op = 4, return to executing from the FPC FIFO
+ * TIMESTAMP: op = 5, send fpc_data[47:32] copies of a free running
+ *        64 bit clock cycle count to the TPC FIFO, as READ does with rdata
+ *
+ * A program runs until HALT or until a word arrives in the FPC FIFO,
+ * which stops it at the next instruction boundary. NOPs arriving while a
+ * program runs are discarded rather than stopping it, hosts pad to the
+ * FIFO word size with them.
  */
 
 module sequencer
@@ -77,45 +92,126 @@ module sequencer
    parameter DBITS = 64; // 1 to 64
    parameter SBITS = 16; // 1 to 64
    parameter CBITS = 24; // 2 to 28
+   parameter PBITS = 8; // program memory address bits
+
+   localparam OP_LOAD = 1, OP_RUN = 2, OP_LOOP = 3, OP_HALT = 4;
+   localparam OP_TIMESTAMP = 5;
 
    reg [CBITS-1:0] 	  count = 32'hDEADBEEF;
-   reg [1:0] 		  state = 0;
+   reg [2:0] 		  state = 0;
    reg 			  inc = 0;
+   // program memory, distributed RAM
+   reg [63:0] 		  pmem [0:2**PBITS-1];
+   reg [PBITS-1:0] 	  pc = 0;
+   reg [PBITS-1:0] 	  load_addr = 0;
+   reg 			  running = 0;
+   reg [15:0] 		  loop_count = 0;
+   reg 			  looping = 0;
+   // timestamps share the read pipeline
+   reg [63:0] 		  cycles = 0;
+   reg [63:0] 		  stamp [0:RPIPE];
+   reg 			  stamping = 0;
+   reg 			  svalid = 0;
+   wire 		  stamp_write;
+   wire 		  read_write;
+   integer 		  i;
+
+   // instruction source, program memory or FPC FIFO
+   wire [63:0] 		  instr = running ? pmem[pc] : fpc_data;
+   wire 		  skip = running && fpc_valid && (fpc_data == 0);
+   wire 		  preempt = running && fpc_valid && (fpc_data != 0) &&
+			  (state == 0);
+   wire 		  src_valid = running ? ~preempt : fpc_valid;
+   wire 		  src_read = src_valid &&
+			  ((state == 0) || (state == 2) || (state == 4));
+   wire 		  decode = src_read && (state == 0);
+   wire 		  ext = decode && (instr[63:62] == 0);
+   wire [5:0] 		  ext_op = instr[61:56];
+   wire [15:0] 		  ext_count = instr[47:32];
+   wire [PBITS-1:0] 	  ext_addr = instr[PBITS-1:0];
+   wire 		  jump = ext && (ext_op == OP_LOOP) &&
+			  ((ext_count == 0) ||
+			   (looping ? (loop_count != 0) : (ext_count > 1)));
 
    wire 		  rvalid_next = (state == 3) && tpc_ready;
-   wire 		  wvalid_next = (state == 2) && fpc_read;
+   wire 		  wvalid_next = (state == 2) && src_read;
+   wire 		  last = (count[CBITS-1:1] == 0);
 
-   assign fpc_read = fpc_valid && ((state == 0) || (state == 2));
+   assign fpc_read = (src_read && ~running) || skip;
 
    always @ (posedge clock)
      begin
-	rvalid <= rvalid_next;
+	rvalid <= rvalid_next && ~stamping;
+	svalid <= rvalid_next && stamping;
+	cycles <= cycles + 1'b1;
+	stamp[0] <= cycles;
+	for(i=1; i<=RPIPE; i=i+1)
+	  stamp[i] <= stamp[i-1];
+	if(decode)
+	  stamping <= ext && (ext_op == OP_TIMESTAMP);
 	wvalid <= wvalid_next;
-	address <= (state == 0) ? fpc_data[ABITS-1:0] :
+	address <= (state == 0) ? instr[ABITS-1:0] :
 		   address + (inc && (rvalid || wvalid));
-	wdata <= fpc_data[DBITS-1:0];
-	inc <= (state == 0) ? fpc_data[61] : inc;
+	wdata <= instr[DBITS-1:0];
+	inc <= (state == 0) ? instr[61] : inc;
 	case(state)
-	  0: count <= fpc_data[CBITS+31:32];
+	  0: count <= instr[CBITS+31:32];
 	  1: count <= count - 1'b1;
 	  2: count <= count - wvalid_next;
 	  3: count <= count - rvalid_next;
+	  4: count <= count - src_read;
 	endcase
+	// program memory load
+	if(decode)
+	  load_addr <= ext_addr;
+	else if((state == 4) && src_read)
+	  load_addr <= load_addr + 1'b1;
+	if((state == 4) && src_read)
+	  pmem[load_addr] <= instr;
+	// program counter
+	if(reset)
+	  running <= 1'b0;
+	else if(preempt || (ext && (ext_op == OP_HALT)))
+	  running <= 1'b0;
+	else if(ext && (ext_op == OP_RUN))
+	  running <= 1'b1;
+	if(ext && ((ext_op == OP_RUN) || jump))
+	  pc <= ext_addr;
+	else if(running && src_read)
+	  pc <= pc + 1'b1;
+	// loop counter, counts remaining passes of the body
+	if(reset || (ext && (ext_op == OP_RUN)))
+	  looping <= 1'b0;
+	else if(ext && (ext_op == OP_LOOP) && (ext_count != 0))
+	  begin
+	     looping <= jump;
+	     loop_count <= looping ? loop_count - 1'b1 : ext_count - 2'd2;
+	  end
 	if(reset)
-	  state <= 2'd0;
+	  state <= 3'd0;
 	else
 	  begin
 	     case(state)
-	       0: state <= fpc_read ? fpc_data[63:62] : 2'd0; // idle, nop
-	       // wait, read, write
-	       default: state <= (count[CBITS-1:1] == 0) ? 2'd0 : state;
+	       0: state <= ~decode ? 3'd0 :
+			   (instr[63:62] != 0) ? {1'b0, instr[63:62]} :
+			   (ext_op == OP_LOAD) && (ext_count != 0) ? 3'd4 :
+			   (ext_op == OP_TIMESTAMP) && (ext_count != 0) ? 3'd3 :
+			   3'd0;
+	       1: state <= last ? 3'd0 : 3'd1; // wait
+	       2: state <= last && wvalid_next ? 3'd0 : 3'd2; // write
+	       3: state <= last && rvalid_next ? 3'd0 : 3'd3; // read
+	       4: state <= last && src_read ? 3'd0 : 3'd4; // load
+	       default: state <= 3'd0;
 	     endcase
 	  end
      end
    // delay tpc_write RPIPE cycles from rvalid to allow for a read pipeline
    delay_n #(.N(RPIPE)) delay_tpc_write
-     (.clock(clock), .in(rvalid), .out(tpc_write));
-   assign tpc_data = rdata;
+     (.clock(clock), .in(rvalid), .out(read_write));
+   delay_n #(.N(RPIPE)) delay_stamp_write
+     (.clock(clock), .in(svalid), .out(stamp_write));
+   assign tpc_write = read_write || stamp_write;
+   assign tpc_data = stamp_write ? stamp[RPIPE] : rdata;
 
 endmodule
 
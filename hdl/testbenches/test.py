@@ -56,8 +56,8 @@ def run_test(dut):
     # enable interrupts
     pci.write(0xF, 0*8)
     # release reset
-    pci.write(0xFF, 4*8)
-    # release aborts
+    pci.write(0xFFFFFFFFFFFFFFFF, 4*8)
+    # release aborts, FIFO numbers are for the default NCH of 4
     for i in range(8):
         pci.write_fifo(fifo=i, data = 0x0 | 4)
     #FPC
@@ -106,9 +106,9 @@ def run_test(dut):
     print a
     for i in range(17000):
         yield RisingEdge(clock)
-    a = yield pci.read(64 + 1*8, 4)
+    a = yield pci.read((64+1)*8, 4)
     print a
-    a = yield pci.read(64 + 5*8, 4)
+    a = yield pci.read((64+5)*8, 4)
     print a
 
     check_end = 0x800000/8
@@ -172,20 +172,24 @@ class PCIe_host():
         yield self.read_wait.wait()
         raise ReturnValue(self.read_data)
 
-    def complete(self, address, reqid_tag):
+    def complete(self, address, reqid_tag, length):
         address &= 0xFFFF8
         address = address >> 3
         complete_size = random.choice([16,32]) # DW
-        cdata_64 = self.completion_data[address:address + 512/8]
+        cdata_64 = self.completion_data[address:address + length/2]
         cdata_32 = np.fromstring(cdata_64.tostring(), dtype = 'uint32')
         cdata_32.byteswap(True)
-        for i in range(128/complete_size):
-            tlp = np.zeros(4 + complete_size, dtype='uint32')
-            tlp[0] = 0x4A000000 | complete_size
-            tlp[1] = 0xbeef0000 | (512-complete_size*4*i)
+        remaining = length
+        i = 0
+        while remaining > 0:
+            size = min(complete_size, remaining)
+            tlp = np.zeros(4 + size, dtype='uint32')
+            tlp[0] = 0x4A000000 | size
+            tlp[1] = 0xbeef0000 | (remaining*4)
             tlp[2] = (reqid_tag << 8) | ((i & 1) << 6)
-            tlp[3:3+complete_size] = cdata_32[i*complete_size: (i+1)*complete_size]
-            address += complete_size/2
+            tlp[3:3+size] = cdata_32[length - remaining: length - remaining + size]
+            remaining -= size
+            i += 1
             self.txqueue.put(tlp)
 
     @cocotb.coroutine
@@ -247,7 +251,7 @@ class PCIe_host():
                     if tlptype == 0b0000000: # read
                         #print "{} bit read request at 0x{:016X}, tag = 0x{:02X}, length = {} dw".format(bits, address, int(dw1 >> 8 & 0xFF), length)
                         reqid_tag = 0xFFFFFF & (dw1 >> 8)
-                        self.complete(address, reqid_tag)
+                        self.complete(address, reqid_tag, length)
                     elif tlptype == 0b1000000: # write
                         self.handle_write_tlp(bits, address, length, self.rxdata)
                     elif tlptype == 0b1001010: # read completion
@@ -288,7 +292,7 @@ class PCIe_host():
         self.write_data[addr_start:addr_start + length/2] = d
         #print "d[{}] = 0x{:016X}".format(0, d[0])
     def write_fifo(self, fifo, data):
-        self.write(data, (8+fifo)*8)
+        self.write(data, (64+fifo)*8)
 
 def seq_wait(x):
     return 1<<60 | x
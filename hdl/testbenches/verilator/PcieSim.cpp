@@ -0,0 +1,306 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <stdexcept>
+
+#include "Vvna_dsp.h"
+#include "Vvna_dsp__Dpi.h"
+#include "svdpi.h"
+#include "PcieSim.h"
+
+using namespace std;
+
+static PcieSim *sim = NULL; // the DPI has no context pointer
+
+static inline uint32_t es(uint32_t x) // endian swap
+{
+	return __builtin_bswap32(x);
+}
+
+void hififo_sim_cycle(int dwords, svBit tx_valid, long long tx_data_0,
+		      long long tx_data_1, int tx_keep, svBit tx_last,
+		      svBit interrupt, svBit *tx_ready, svBit *rx_valid,
+		      long long *rx_data_0, long long *rx_data_1, int *rx_sof,
+		      int *rx_eof, svBit *reset)
+{
+	bool o_tx_ready, o_rx_valid, o_reset;
+	uint32_t tx_dw[4], rx_dw[4], o_rx_sof, o_rx_eof;
+	tx_dw[0] = tx_data_0;
+	tx_dw[1] = (uint64_t) tx_data_0 >> 32;
+	tx_dw[2] = tx_data_1;
+	tx_dw[3] = (uint64_t) tx_data_1 >> 32;
+	sim->cycle(dwords, tx_valid, tx_dw, tx_keep, tx_last, interrupt,
+		   &o_tx_ready, &o_rx_valid, rx_dw, &o_rx_sof, &o_rx_eof,
+		   &o_reset);
+	*tx_ready = o_tx_ready;
+	*rx_valid = o_rx_valid;
+	*rx_data_0 = rx_dw[0] | (uint64_t) rx_dw[1] << 32;
+	*rx_data_1 = rx_dw[2] | (uint64_t) rx_dw[3] << 32;
+	*rx_sof = o_rx_sof;
+	*rx_eof = o_rx_eof;
+	*reset = o_reset;
+}
+
+PcieSim::PcieSim(size_t mem_bytes, uint64_t bus_base, unsigned seed)
+	: memory(mem_bytes/8, 0), rng(seed)
+{
+	if(sim != NULL)
+		throw std::runtime_error("hififo sim: only one PcieSim at a time");
+	sim = this;
+	this->bus_base = bus_base;
+	rx_index = 0;
+	tx_ready = false;
+	interrupt_prev = false;
+	read_done = false;
+	read_data = 0;
+	cycles = 0;
+	interrupts = 0;
+	completion_latency = 0;
+	full_rate = false;
+	top = new Vvna_dsp;
+	top->pcie_refclk_p = 0;
+	top->pcie_refclk_n = 1;
+	top->pcie_rst_n = 1;
+	top->pcie_rxp = 0;
+	top->pcie_rxn = 0;
+	top->cflash_sdo = 0;
+	step(64);
+	// as the driver does at probe
+	nch = read32(7*8);
+	write64(3*8, ~0UL); // reset set
+	write64(4*8, ~0UL); // reset clear
+	write64(0*8, 0xFFFF); // enable interrupts
+	step(64);
+}
+
+PcieSim::~PcieSim()
+{
+	top->final();
+	delete top;
+	sim = NULL;
+}
+
+bool PcieSim::chance(int percent)
+{
+	return !full_rate && ((int) (rng() % 100) < percent);
+}
+
+void PcieSim::step(uint64_t n)
+{
+	std::lock_guard<std::recursive_mutex> lk(lock);
+	while(n--){
+		top->pcie_refclk_p = 0;
+		top->eval();
+		top->pcie_refclk_p = 1;
+		top->eval();
+	}
+}
+
+uint64_t * PcieSim::host(uint64_t bus_addr)
+{
+	uint64_t i = (bus_addr - bus_base) / 8;
+	if((bus_addr < bus_base) || (i >= memory.size()))
+		throw std::runtime_error("hififo sim: DMA outside host memory");
+	return &memory[i];
+}
+
+void PcieSim::write64(uint32_t offset, uint64_t data)
+{
+	if(offset + 8 > BAR0_SIZE)
+		throw std::runtime_error("hififo sim: write outside BAR0");
+	std::lock_guard<std::recursive_mutex> lk(lock);
+	pio.push_back({0x40000002, 0xbeef00ff, offset,
+				es(data), es(data >> 32)});
+}
+
+uint32_t PcieSim::read32(uint32_t offset)
+{
+	if(offset + 4 > BAR0_SIZE)
+		throw std::runtime_error("hififo sim: read outside BAR0");
+	std::lock_guard<std::recursive_mutex> lk(lock);
+	read_done = false;
+	pio.push_back({0x00000001, 0xbaaa00ff, offset});
+	for(int i=0; !read_done; i++){
+		if(i == 100000)
+			throw std::runtime_error("hififo sim: PIO read timed out");
+		step(1);
+	}
+	return read_data;
+}
+
+bool PcieSim::wait(std::function<bool()> ready, uint64_t max_cycles)
+{
+	uint64_t end = cycles + max_cycles;
+	while(true){
+		{
+			std::lock_guard<std::recursive_mutex> lk(lock);
+			if(ready())
+				return true;
+			if(cycles >= end)
+				return false;
+			uint64_t irq = interrupts;
+			uint64_t stop = min(cycles + 4096, end);
+			while((cycles < stop) && (interrupts == irq))
+				step(1);
+		}
+		std::this_thread::yield();
+	}
+}
+
+// split at random 64 byte boundaries, in order within a request
+void PcieSim::complete(uint64_t address, uint32_t reqid_tag, uint32_t length)
+{
+	std::deque<tlp> request;
+	uint32_t remaining = length == 0 ? 1024 : length;
+	while(remaining != 0){
+		uint32_t size = 16 - ((address / 4) % 16);
+		if(chance(50))
+			size += 16;
+		size = min(size, remaining);
+		tlp t(3 + size, 0);
+		t[0] = 0x4A000000 | size;
+		t[1] = 0xbeef0000 | ((remaining * 4) & 0xFFF);
+		t[2] = (reqid_tag << 8) | (address & 0x7F);
+		host((address + 4*size - 4) & ~7L); // bounds check
+		uint32_t *src = (uint32_t *) host(address & ~7L);
+		if(address & 4)
+			src++;
+		for(uint32_t i=0; i<size; i++)
+			t[3+i] = es(src[i]);
+		request.push_back(t);
+		address += 4 * size;
+		remaining -= size;
+	}
+	completions.push_back(request);
+	completion_due.push_back(cycles + completion_latency);
+}
+
+void PcieSim::device_tlp(const tlp & t)
+{
+	uint32_t type = (t[0] >> 24) & 0x5F;
+	uint32_t length = t[0] & 0x3FF;
+	bool is64 = (t[0] & 0x20000000) != 0;
+	uint64_t address = is64 ? ((uint64_t) t[2] << 32) | t[3] : t[2];
+	size_t hlen = is64 ? 4 : 3;
+	if(type == 0x00){ // read request
+		complete(address, t[1] >> 8, length);
+	}
+	else if(type == 0x40){ // write request
+		if((length & 1) || (t.size() < hlen + length))
+			throw std::runtime_error("hififo sim: bad write TLP length");
+		uint64_t *dst = host(address);
+		for(uint32_t i=0; i<length/2; i++)
+			dst[i] = es(t[hlen+2*i]) | (uint64_t) es(t[hlen+2*i+1]) << 32;
+	}
+	else if(type == 0x4A){ // completion of a PIO read
+		if((length != 1) || (t.size() < 4))
+			throw std::runtime_error("hififo sim: bad completion TLP");
+		read_data = es(t[3]);
+		read_done = true;
+	}
+	else{
+		fprintf(stderr, "hififo sim: unknown TLP %08x %08x %08x\n",
+			t[0], t[1], t[2]);
+		throw std::runtime_error("hififo sim: unknown TLP");
+	}
+}
+
+// start the next TLP to the device, false if there is none
+bool PcieSim::next_tlp()
+{
+	rx.clear();
+	rx_index = 0;
+	eligible.clear();
+	for(size_t i=0; i<completions.size(); i++)
+		if(completion_due[i] <= cycles)
+			eligible.push_back(i);
+	if(!pio.empty() && (eligible.empty() || (rng() % 2))){
+		rx = pio.front();
+		pio.pop_front();
+	}
+	else if(!eligible.empty()){
+		size_t i = eligible[rng() % eligible.size()];
+		rx = completions[i].front();
+		completions[i].pop_front();
+		if(completions[i].empty()){
+			completions[i] = completions.back();
+			completions.pop_back();
+			completion_due[i] = completion_due.back();
+			completion_due.pop_back();
+		}
+	}
+	return !rx.empty();
+}
+
+void PcieSim::cycle(int dwords, bool tx_valid, const uint32_t *tx_data,
+		    uint32_t tx_keep, bool tx_last, bool interrupt,
+		    bool *o_tx_ready, bool *rx_valid, uint32_t *rx_data,
+		    uint32_t *rx_sof, uint32_t *rx_eof, bool *reset)
+{
+	cycles++;
+	*reset = cycles < 16;
+	if(interrupt && !interrupt_prev)
+		interrupts++;
+	interrupt_prev = interrupt;
+	// device to host, tx_ready is the value presented this cycle
+	if(tx_valid && tx_ready){
+		for(int i=0; i<dwords; i++)
+			if(tx_keep & (1 << i))
+				tx.push_back(tx_data[i]);
+		if(tx_last){
+			device_tlp(tx);
+			tx.clear();
+		}
+	}
+	tx_ready = !chance(25);
+	*o_tx_ready = tx_ready;
+	/*
+	 * host to device, is_sof and is_eof style framing: bit 4 present,
+	 * bits 3:0 the byte offset of the first DW or of the last byte. A
+	 * TLP starts in DW0, or in DW2 of a 128 bit beat, straddling the
+	 * end of the previous one or at random.
+	 */
+	for(int i=0; i<dwords; i++)
+		rx_data[i] = 0;
+	*rx_sof = 0;
+	*rx_eof = 0;
+	*rx_valid = false;
+	if(chance(20))
+		return;
+	int d = 0;
+	while(d < dwords){
+		if(rx_index >= rx.size()){
+			if((d > 2) || ((dwords == 2) && (d != 0)))
+				break;
+			if(d != 0)
+				d = 2;
+			if(!next_tlp())
+				break;
+			if((dwords == 4) && (d == 0) && chance(25))
+				d = 2;
+			*rx_sof = 0x10 | (4 * d);
+		}
+		rx_data[d++] = rx[rx_index++];
+		*rx_valid = true;
+		if(rx_index >= rx.size())
+			*rx_eof = 0x10 | (4 * d - 1);
+	}
+}
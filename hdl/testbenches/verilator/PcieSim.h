@@ -0,0 +1,91 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <random>
+#include <functional>
+
+class Vvna_dsp;
+
+/*
+ * PCI Express host model for the Verilator build of the hififo core.
+ *
+ * Models the root complex: BAR0 writes and 32 bit reads, host memory for
+ * DMA, and completions for DMA reads. Completions are split at random
+ * 64 byte boundaries and returned out of order across tags, no sooner
+ * than completion_latency cycles after the request. The host
+ * side of the AXI stream inserts random idle cycles and the device side
+ * sees random backpressure, unless full_rate is set. With the 128 bit
+ * interface, TLPs straddle beats as the core's do.
+ *
+ * The simulation only advances while some thread is stepping it, all
+ * stepping is serialized by lock.
+ */
+
+#define BAR0_SIZE 1024 // as init.tcl
+
+class PcieSim {
+private:
+	typedef std::vector<uint32_t> tlp;
+	Vvna_dsp *top;
+	std::vector<uint64_t> memory;
+	std::deque<tlp> pio; // host requests, in order
+	std::vector<std::deque<tlp>> completions; // per request, any order
+	std::vector<uint64_t> completion_due; // cycle each request may start
+	std::vector<size_t> eligible;
+	tlp rx; // TLP being sent to the device
+	size_t rx_index; // DWs of rx sent
+	tlp tx; // TLP being received from the device
+	bool tx_ready;
+	bool interrupt_prev;
+	bool read_done;
+	uint32_t read_data;
+	std::mt19937 rng;
+	void device_tlp(const tlp & t);
+	void complete(uint64_t address, uint32_t reqid_tag, uint32_t length);
+	bool next_tlp();
+	bool chance(int percent);
+public:
+	std::recursive_mutex lock;
+	uint64_t bus_base; // bus address of host memory
+	uint64_t cycles;
+	uint64_t interrupts;
+	uint64_t completion_latency; // cycles from read request to first completion
+	int nch; // channels each way, to PC FIFO n is nch + n
+	bool full_rate; // no idle cycles or backpressure
+	PcieSim(size_t mem_bytes = 64<<20, uint64_t bus_base = 1L<<32,
+		unsigned seed = 1);
+	~PcieSim();
+	void step(uint64_t n = 1);
+	void write64(uint32_t offset, uint64_t data);
+	uint32_t read32(uint32_t offset);
+	// step until ready() or max_cycles, checking after each interrupt
+	bool wait(std::function<bool()> ready, uint64_t max_cycles);
+	uint64_t *host(uint64_t bus_addr);
+	// called from the DPI once per clock, beats of dwords 32 bit words
+	void cycle(int dwords, bool tx_valid, const uint32_t *tx_data,
+		   uint32_t tx_keep, bool tx_last, bool interrupt,
+		   bool *o_tx_ready, bool *rx_valid, uint32_t *rx_data,
+		   uint32_t *rx_sof, uint32_t *rx_eof, bool *reset);
+};
@@ -0,0 +1,183 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+
+#include "SimHififo.h"
+
+using namespace std;
+
+#define BUFFER_SIZE (4 << 20)
+#define BUFFER_MASK (BUFFER_SIZE - 1)
+#define CLOCK_HZ 250e6
+
+SimHififo::SimHififo(PcieSim *sim, int n) : Hififo(n >= sim->nch)
+{
+	this->sim = sim;
+	this->n = n;
+	ring = sim->bus_base + (uint64_t) n * BUFFER_SIZE;
+	p_sw = 0;
+	bytes_available = 0;
+	word = sim->read32(8*8);
+	if(word == 0)
+		word = 8;
+	nch = sim->nch;
+	set_timeout(0.01);
+	// as hififo_open
+	command(4 | (1<<8)); // abort
+	sim->step(100);
+	command(3 | ring);
+	command(4); // clear abort
+	sim->step(100);
+	if(to_pc)
+		command(2 | (p_sw + BUFFER_SIZE - 512)); // stop
+}
+
+SimHififo::~SimHififo()
+{
+	command(4 | (1<<8));
+	sim->step(100);
+}
+
+void SimHififo::command(uint64_t v)
+{
+	sim->write64((64+n)*8, v);
+}
+
+bool SimHififo::ready_read(uint32_t count)
+{
+	if(bytes_available >= count)
+		return true;
+	uint32_t p_hw = sim->read32((64+n)*8);
+	bytes_available = BUFFER_MASK & (p_hw - p_sw);
+	return bytes_available >= count;
+}
+
+bool SimHififo::ready_write(uint32_t count)
+{
+	if(bytes_available >= count)
+		return true;
+	uint32_t p_hw = sim->read32((64+n)*8);
+	uint32_t bytes_in_ring = BUFFER_MASK & (p_sw - p_hw);
+	bytes_available = BUFFER_SIZE - (bytes_in_ring + 512);
+	return bytes_available >= count;
+}
+
+ssize_t SimHififo::dev_read(void *buf, size_t count)
+{
+	if((count % word) != 0){
+		errno = EINVAL;
+		return -1;
+	}
+	size_t copied = 0;
+	while(copied < count){
+		uint32_t csize = min((size_t) BUFFER_SIZE/2, count - copied);
+		csize = min(csize, BUFFER_SIZE - p_sw);
+		command(2 | (p_sw + BUFFER_SIZE - 512)); // stop
+		command(1 | (p_sw + csize)); // match
+		if(!sim->wait([&]{ return ready_read(csize); }, timeout))
+			break;
+		memcpy((char *) buf + copied, sim->host(ring + p_sw), csize);
+		p_sw = (p_sw + csize) & BUFFER_MASK;
+		bytes_available -= csize;
+		copied += csize;
+	}
+	if(copied == 0){
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	return copied;
+}
+
+ssize_t SimHififo::dev_write(const void *buf, size_t count)
+{
+	if((count % word) != 0){
+		errno = EINVAL;
+		return -1;
+	}
+	size_t copied = 0;
+	while(copied < count){
+		uint32_t csize = min((size_t) BUFFER_SIZE/2, count - copied);
+		csize = min(csize, BUFFER_SIZE - p_sw);
+		command(1 | (p_sw + csize + 512 - BUFFER_SIZE)); // match
+		if(!sim->wait([&]{ return ready_write(csize); }, timeout))
+			break;
+		memcpy(sim->host(ring + p_sw), (const char *) buf + copied, csize);
+		p_sw = (p_sw + csize) & BUFFER_MASK;
+		command(2 | p_sw); // stop
+		bytes_available -= csize;
+		copied += csize;
+	}
+	if(copied == 0){
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	return copied;
+}
+
+// as the driver's IOC_FLUSH
+size_t SimHififo::flush()
+{
+	uint32_t p_hw = sim->read32((64+n)*8);
+	size_t discarded = BUFFER_MASK & (to_pc ? p_hw - p_sw : p_sw - p_hw);
+	uint64_t mask = 1ULL << (to_pc ? 32 + n - sim->nch : n);
+	command(4 | (1<<8)); // abort
+	sim->step(CLOCK_HZ / 10000); // 100 us for reads in flight
+	sim->write64(3*8, mask); // FIFO reset
+	sim->step(10);
+	sim->write64(4*8, mask);
+	p_sw = 0;
+	bytes_available = 0;
+	command(3 | ring);
+	command(4); // clear abort
+	if(to_pc)
+		command(2 | (p_sw + BUFFER_SIZE - 512)); // stop
+	return discarded;
+}
+
+void SimHififo::set_framing(size_t words)
+{
+	command(6 | (words ? (1<<8) : 0) | ((uint64_t) words << 16));
+	flush();
+}
+
+void SimHififo::set_timeout(double timeout)
+{
+	this->timeout = (uint64_t) (timeout * CLOCK_HZ);
+}
+
+void SimHififo::get_counters(hififo_counters *c)
+{
+	uint32_t *p = (uint32_t *) c;
+	for(size_t i=0; i<sizeof(*c)/4; i++)
+		p[i] = sim->read32((16+i)*8);
+}
+
+void SimHififo::clear_counters()
+{
+	sim->write64(5*8, 0);
+}
+
+char * SimHififo::get_fpga_build_time()
+{
+	time_t ts = (time_t) sim->read32(2*8);
+	return asctime(localtime(&ts));
+}
@@ -0,0 +1,55 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include "Hififo.h"
+#include "PcieSim.h"
+
+/*
+ * Hififo transport over the simulated core. Does what the kernel driver
+ * does for one FIFO: owns a 4 MB ring in host memory, moves the stop and
+ * match pointers and polls the hardware pointer after interrupts.
+ * Timeouts are in simulated time.
+ */
+
+class SimHififo : public Hififo {
+private:
+	PcieSim *sim;
+	int n;
+	bool to_pc;
+	uint64_t ring; // bus address
+	uint32_t p_sw;
+	uint32_t bytes_available;
+	uint64_t timeout; // clock cycles
+	void command(uint64_t v);
+	bool ready_read(uint32_t count);
+	bool ready_write(uint32_t count);
+protected:
+	ssize_t dev_read(void *buf, size_t count);
+	ssize_t dev_write(const void *buf, size_t count);
+public:
+	SimHififo(PcieSim *sim, int n);
+	~SimHififo();
+	void set_timeout(double timeout);
+	size_t flush();
+	void set_framing(size_t words);
+	char * get_fpga_build_time();
+	void get_counters(hififo_counters *c);
+	void clear_counters();
+};
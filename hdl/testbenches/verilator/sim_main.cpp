@@ -0,0 +1,316 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+/*
+ * Drives the Verilator model of the hififo core with the host library.
+ * FIFO map as in top.v: 0 -> 4 loopback, 1/5 sequencer, 2 sink,
+ * 6 counter source.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include "verilated.h"
+#include "TimeIt.h"
+#include "Pattern.h"
+#include "Frame.h"
+#include "Sequencer.h"
+#include "PcieSim.h"
+#include "SimHififo.h"
+#include "Trace.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what)
+{
+	if(!ok){
+		cerr << "FAIL: " << what << "\n";
+		failures++;
+	}
+}
+
+static void writer(Hififo *f, size_t words, size_t bs)
+{
+	Pattern pattern{PATTERN_LFSR, 0x0123456789ABCDEF};
+	vector<uint64_t> buf(bs);
+	for(size_t i=0; i<words; i+=bs){
+		size_t n = min(bs, words - i);
+		pattern.generate(buf.data(), n);
+		f->bwrite((char *) buf.data(), 8*n);
+	}
+}
+
+static uint64_t checker(Hififo *f, size_t words, size_t bs)
+{
+	Pattern pattern{PATTERN_LFSR};
+	vector<uint64_t> buf(bs);
+	for(size_t i=0; i<words; i+=bs){
+		size_t n = min(bs, words - i);
+		f->bread(buf.data(), 8*n);
+		pattern.check(buf.data(), n);
+	}
+	pattern.report("loopback");
+	return pattern.errors.word_errors;
+}
+
+static void test_loopback(PcieSim *sim, size_t words, size_t bs)
+{
+	SimHififo f0{sim, 0};
+	SimHififo f4{sim, sim->nch};
+	uint64_t errors = 0;
+	TimeIt timer{};
+	uint64_t c0 = sim->cycles;
+	std::thread t_writer(writer, &f0, words, bs);
+	std::thread t_reader([&]{ errors = checker(&f4, words, bs); });
+	t_writer.join();
+	t_reader.join();
+	cerr << "loopback " << 8*words << " bytes in blocks of " << 8*bs
+	     << ": " << sim->cycles - c0 << " cycles, "
+	     << timer.elapsed() << " s\n";
+	expect(errors == 0, "loopback data");
+}
+
+static void test_counter(PcieSim *sim, size_t words)
+{
+	SimHififo f6{sim, sim->nch + 2};
+	vector<uint64_t> buf(words);
+	f6.bread(buf.data(), 8*words);
+	size_t errors = 0;
+	for(size_t i=1; i<words; i++)
+		errors += buf[i] != buf[i-1] + 1;
+	expect(errors == 0, "counter source");
+	// the sink accepts anything
+	SimHififo f2{sim, 2};
+	f2.bwrite((char *) buf.data(), 8*words);
+}
+
+static void test_sequencer(PcieSim *sim)
+{
+	SimHififo f1{sim, 1};
+	SimHififo f5{sim, sim->nch + 1};
+	Sequencer seq{&f1, &f5};
+	seq.write(0, 0x1234567890ABCDEF, 1);
+	expect(seq.read(0) == 0x1234567890ABCDEF, "sequencer register 0");
+	for(uint32_t a=1; a<4; a++)
+		expect(seq.read(a) == a, "sequencer constant registers");
+	// program: read the constants at 1 and 2, five passes
+	seq.program_begin();
+	seq.read_req(2, 1);
+	seq.loop(0, 5);
+	seq.halt();
+	seq.program_end(0);
+	seq.run_program(0);
+	seq.run();
+	uint64_t r[10];
+	seq.read_stream(r, 10);
+	bool ok = true;
+	for(int i=0; i<10; i++)
+		ok &= r[i] == (uint64_t) (1 + (i & 1));
+	expect(ok, "sequencer program loop");
+	// halt stops a program looping forever and drops its results
+	seq.program_begin();
+	seq.read_req(2, 1);
+	seq.loop(0, 0);
+	seq.program_end(0);
+	seq.run_program(0);
+	seq.run();
+	seq.read_stream(r, 4);
+	seq.halt();
+	expect(seq.read(0) == 0x1234567890ABCDEF, "sequencer halt resync");
+	// timestamps bracket a fixed wait
+	uint64_t t0, t1;
+	seq.timestamp(&t0);
+	seq.wait(100);
+	seq.timestamp(&t1);
+	seq.run();
+	cerr << "timestamp delta " << t1 - t0 << " cycles\n";
+	expect((t1 - t0 >= 100) && (t1 - t0 < 200), "sequencer timestamp");
+}
+
+// BIST LFSR source to the host checker and host LFSR to the BIST sink
+static void test_bist(PcieSim *sim, size_t words)
+{
+	SimHififo f1{sim, 1};
+	SimHififo f5{sim, sim->nch + 1};
+	Sequencer seq{&f1, &f5};
+	uint64_t seed = 0x0123456789ABCDEF;
+	seq.write_single(16, 0); // stop the source
+	seq.run();
+	// discard what it left
+	SimHififo f6{sim, sim->nch + 2};
+	sim->step(20000);
+	size_t discarded = f6.flush();
+	f6.set_timeout(1e-5);
+	expect((discarded > 0) && (f6.get_buffer(4096) == NULL), "flush");
+	f6.set_timeout(0.01);
+	seq.write_single(17, seed);
+	seq.write_single(16, 3); // enable, LFSR
+	seq.run();
+	vector<uint64_t> buf(words);
+	f6.bread(buf.data(), 8*words);
+	Pattern host{PATTERN_LFSR};
+	host.check(buf.data(), words);
+	expect((buf[0] == seed) && (host.errors.word_errors == 0),
+	       "BIST source");
+	seq.write_single(17, 0);
+	seq.write_single(16, 1); // back to the counter
+	seq.write_single(18, 7); // enable, LFSR, check
+	seq.run();
+	SimHififo f2{sim, 2};
+	Pattern gen{PATTERN_LFSR, seed};
+	gen.generate(buf.data(), words);
+	buf[words/2] ^= 1L << 40; // one bad qword, two mispredictions
+	f2.bwrite((char *) buf.data(), 8*words);
+	uint64_t fifo_words = 8 * words / f2.word_bytes();
+	for(int i=0; (i < 1000) && (seq.read(18) != fifo_words); i++)
+		sim->step(100);
+	uint64_t errors = seq.read(19);
+	cerr << "BIST sink " << seq.read(18) << " words in " << seq.read(20)
+	     << " cycles, " << errors << " errors\n";
+	expect(errors == 2, "BIST sink");
+	seq.write_single(18, 1);
+	seq.run();
+}
+
+// frames of the BIST counter source, then a corrupted and a missing frame
+static void test_framer(PcieSim *sim, size_t words, size_t nframes)
+{
+	SimHififo f6{sim, sim->nch + 2};
+	f6.set_framing(words);
+	FrameChecker fc{f6.word_bytes(), words};
+	size_t fb = fc.frame_bytes();
+	vector<uint64_t> buf(nframes * fb / 8);
+	vector<const char *> data(nframes);
+	f6.bread(buf.data(), nframes * fb);
+	size_t good = fc.check(buf.data(), nframes * fb, data.data());
+	Pattern counter{PATTERN_COUNTER};
+	for(size_t i=0; i<good; i++)
+		counter.check((const uint64_t *) data[i], fc.data_bytes() / 8);
+	fc.report("framer");
+	expect((good == nframes) && (counter.errors.word_errors == 0),
+	       "framer");
+	char *p = (char *) buf.data();
+	p[fb + 20] ^= 1; // frame 1 data
+	memmove(p + 2*fb, p + 3*fb, (nframes - 3) * fb); // drop frame 2
+	fc.clear();
+	good = fc.check(p, (nframes - 1) * fb);
+	fc.report("framer errors");
+	expect((good == nframes - 2) && (fc.errors.crc_errors == 1) &&
+	       (fc.errors.lost == 1), "framer errors");
+	f6.set_framing(0);
+}
+
+/*
+ * From PC throughput into the sink on FIFO 2 against completion latency.
+ * Run with +dcommand=<hex> to set the max read request size and
+ * extended tags, and build with FPC_TAG_BITS / FPC_REQ_BITS to size the
+ * tags and reorder buffer.
+ */
+static void bench(PcieSim *sim, size_t words)
+{
+	SimHififo f2{sim, 2};
+	f2.set_timeout(1.0);
+	vector<uint64_t> buf(words, 0);
+	uint64_t latencies[] = {0, 125, 250, 500, 1000, 2000}; // 4 ns cycles
+	uint32_t p_hw = 0;
+	printf("latency_ns MB_s latency_measured_ns tags_out_pct\n");
+	for(auto latency : latencies){
+		sim->completion_latency = latency;
+		f2.clear_counters();
+		uint64_t c0 = sim->cycles;
+		f2.bwrite((char *) buf.data(), 8*words);
+		p_hw = (p_hw + 8*words) & ((4 << 20) - 1);
+		// bwrite returns with the data queued, wait for the FPGA to take it
+		sim->wait([&]{ return sim->read32((64+2)*8) == p_hw; }, ~0UL >> 1);
+		uint64_t cycles = sim->cycles - c0;
+		hififo_counters c;
+		f2.get_counters(&c);
+		printf("%10lu %5.0f %8.0f %5.1f\n", 4*latency,
+		       8.0 * words * 250.0 / cycles,
+		       c.fpc[2].requests ?
+		       4.0 * c.fpc[2].latency_sum / c.fpc[2].requests : 0,
+		       100.0 * c.fpc[2].tag_stall / c.cycles);
+	}
+	sim->completion_latency = 0;
+}
+
+int main(int argc, char **argv)
+{
+	size_t words = 1 << 20;
+	bool bench_only = false;
+	bool full_rate = false;
+	int opt;
+	Verilated::commandArgs(argc, argv); // +dcommand=
+	while((opt = getopt(argc, argv, "n:bf")) != -1){
+		if(opt == 'n')
+			words = strtoul(optarg, NULL, 0);
+		else if(opt == 'b')
+			bench_only = true;
+		else if(opt == 'f')
+			full_rate = true;
+		else{
+			cerr << "usage: " << argv[0]
+			     << " [-n loopback words] [-b] [-f] [+dcommand=hex]\n"
+			     << "  -b  from PC throughput against completion latency\n"
+			     << "  -f  no host idle cycles or backpressure\n";
+			return 1;
+		}
+	}
+	try{
+		PcieSim sim{};
+		sim.full_rate = full_rate;
+		if(bench_only){
+			bench(&sim, 1 << 18);
+			return 0;
+		}
+		SimHififo f0{&sim, 0};
+		cerr << "FPGA built on " << f0.get_fpga_build_time();
+		test_loopback(&sim, words, 32768);
+		test_loopback(&sim, 4098, 98); // odd sizes, 16 byte granular
+		test_counter(&sim, 65536);
+		test_sequencer(&sim);
+		test_bist(&sim, 16384);
+		test_framer(&sim, 64, 16);
+		hififo_counters c;
+		f0.get_counters(&c);
+		cerr << "TX stalled " << c.tx_stall << " of " << c.cycles
+		     << " cycles, " << c.tx_read_requests << " read requests, "
+		     << c.tx_writes << " writes\n";
+		uint32_t requests = 0;
+		for(int i=0; (i<4) && (i<sim.nch); i++)
+			requests += c.fpc[i].requests;
+		expect(c.tx_read_requests == requests, "read request counters");
+		cerr << sim.cycles << " cycles, " << sim.interrupts
+		     << " interrupts\n";
+	}
+	catch(const std::runtime_error & e){
+		cerr << "runtime error " << e.what() << "\n";
+		failures++;
+	}
+	TRACE_EXPORT("sim_trace.json");
+	cerr << (failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
@@ -37,19 +37,44 @@ module vna_dsp
 
    wire 	    clock;
 
-   reg [63:0] 	    tpc_data = 0;
+   localparam DB = `DBITS; // FIFO word bits
+   localparam W = DB / 64;
+
+   reg [DB-1:0]     tpc_data = 0;
    reg 		    tpc_write = 0;
 
-   wire [63:0] 	    fpc_data;
+   wire [DB-1:0]    fpc_data;
    reg 		    fpc_read = 1'b0;
 
-   wire [7:0] 	    fifo_ready, fifo_reset;
+   // FIFO n is from PC channel n, FIFO T + n is to PC channel n
+   localparam T = `NCH;
+   wire [2*T-1:0]   fifo_ready, fifo_reset;
+   wire [DB*T-1:0]  fifo_fpc_data;
    wire [63:0] 	    seq_fpc_data, seq_tpc_data;
    wire 	    seq_read, seq_write;
+   wire [DB-1:0]    seq_fpc_word, seq_tpc_word;
+   wire 	    seq_fifo_read, seq_fifo_write;
 
-   reg [63:0] 	    count = 0;
-   reg 		    count_write = 0;
-   reg 		    null_read = 0;
+   /*
+    * BIST on channel 2, see bist.v, sequencer registers:
+    * 16: write: source control, bit 0 enable, bit 1 LFSR, restarts
+    *     read: source words sent
+    * 17: write: source seed, read: source span
+    * 18: write: sink control, bit 0 enable, bit 1 LFSR, bit 2 check,
+    *     restarts. read: sink words received
+    * 19: read: sink qword errors
+    * 20: read: sink span
+    * After reset the source sends a counter from 0 and the sink
+    * discards everything.
+    */
+   reg [1:0] 	    bist_src_ctl = 2'b01;
+   reg [63:0] 	    bist_src_seed = 0;
+   reg [2:0] 	    bist_snk_ctl = 3'b001;
+   reg 		    bist_src_restart = 0, bist_snk_restart = 0;
+   wire [31:0] 	    bist_src_words, bist_src_span;
+   wire [31:0] 	    bist_snk_words, bist_snk_errors, bist_snk_span;
+   wire [DB-1:0]    bist_src_data;
+   wire 	    bist_src_write, bist_snk_read;
 
    assign cflash_high = 2'b11;
    wire 	    cflash_sck;
@@ -67,9 +92,24 @@ module vna_dsp
    wire [63:0] 	    seq_wdata;
    reg [63:0] 	    seq_rdata0, seq_rdata1;
    reg [63:0] 	    seq_test;
+   reg [63:0] 	    seq_cycles = 0; // free running, for host latency measurement
    wire [7:0] 	    seq_spidata;
    wire [16:0] 	    seq_xadcdata;
 
+   // the example uses channels 0 to 2, `NCH must be at least 3
+   // with `NCH > 3, channel 3 is an always read sink and a zero source,
+   // the tpc data zero extends so channels above 2 send 0
+   wire 	    ch3 = T > 3;
+   wire [2*T-1:0]   fifo_rw = (fpc_read << 0) |
+		    (seq_fifo_read << 1) |
+		    (bist_snk_read << 2) |
+		    ((ch3 && fifo_ready[3]) << 3) |
+		    (tpc_write << T) |
+		    (seq_fifo_write << (T+1)) |
+		    (bist_src_write << (T+2)) |
+		    (ch3 << (T+3));
+   wire [DB*T-1:0]  fifo_tpc_data = {bist_src_data, seq_tpc_word, tpc_data};
+
    hififo_pcie hififo
      (.pci_exp_txp(pcie_txp),
       .pci_exp_txn(pcie_txn),
@@ -88,34 +128,48 @@ module vna_dsp
       .gt_drp_we(gt_drp_we),
       .gt_drp_clock(gt_drp_clock),
 `endif
-      .fifo_clock({8{clock}}),
+      .fifo_clock({2*T{clock}}),
       .fifo_reset(fifo_reset),
       .fifo_ready(fifo_ready),
-      .fifo_rw({1'b1,
-		count_write,
-		seq_write,
-		tpc_write,
-		fifo_ready[3],
-		null_read,
-		seq_read,
-		fpc_read}),
-      .fifo_data_0(fpc_data),
-      .fifo_data_1(seq_fpc_data),
-      .fifo_data_2(),
-      .fifo_data_3(),
-      .fifo_data_4(tpc_data),
-      .fifo_data_5(seq_tpc_data),
-      .fifo_data_6(count),
-      .fifo_data_7(64'h0)
+      .fifo_rw(fifo_rw),
+      .fifo_fpc_data(fifo_fpc_data),
+      .fifo_tpc_data(fifo_tpc_data)
       );
 
+   assign fpc_data = fifo_fpc_data[DB-1:0];
+   assign seq_fpc_word = fifo_fpc_data[2*DB-1:DB];
+
+`ifdef DATA128
+   // the sequencer is 64 bits, low qword of each FIFO word first
+   reg 		    seq_fpc_half = 0, seq_tpc_half = 0;
+   reg [63:0] 	    seq_tpc_low = 0;
+   assign seq_fpc_data = seq_fpc_half ? seq_fpc_word[127:64] :
+			 seq_fpc_word[63:0];
+   assign seq_fifo_read = seq_read && seq_fpc_half;
+   assign seq_fifo_write = seq_write && seq_tpc_half;
+   assign seq_tpc_word = {seq_tpc_data, seq_tpc_low};
+
+   always @ (posedge clock)
+     begin
+	seq_fpc_half <= fifo_reset[1] ? 1'b0 : seq_fpc_half ^ seq_read;
+	seq_tpc_half <= fifo_reset[T+1] ? 1'b0 : seq_tpc_half ^ seq_write;
+	if(seq_write)
+	  seq_tpc_low <= seq_tpc_data;
+     end
+`else
+   assign seq_fpc_data = seq_fpc_word;
+   assign seq_fifo_read = seq_read;
+   assign seq_fifo_write = seq_write;
+   assign seq_tpc_word = seq_tpc_data;
+`endif
+
    sequencer #(.ABITS(16)) sequencer
      (.clock(clock),
       .reset(fifo_reset[1]),
       .fpc_read(seq_read),
       .fpc_valid(fifo_ready[1]),
       .fpc_data(seq_fpc_data),
-      .tpc_ready(fifo_ready[5]),
+      .tpc_ready(fifo_ready[T+1]),
       .tpc_write(seq_write),
       .tpc_data(seq_tpc_data),
       .rvalid(seq_rvalid),
@@ -126,6 +180,35 @@ module vna_dsp
       .status(16'h0)
       );
 
+   bist_source #(.W(W)) bist_source
+     (.clock(clock),
+      .reset(fifo_reset[T+2]),
+      .restart(bist_src_restart),
+      .enable(bist_src_ctl[0]),
+      .lfsr(bist_src_ctl[1]),
+      .seed(bist_src_seed),
+      .fifo_ready(fifo_ready[T+2]),
+      .fifo_write(bist_src_write),
+      .fifo_data(bist_src_data),
+      .words(bist_src_words),
+      .span(bist_src_span)
+      );
+
+   bist_sink #(.W(W)) bist_sink
+     (.clock(clock),
+      .reset(fifo_reset[2]),
+      .restart(bist_snk_restart),
+      .enable(bist_snk_ctl[0]),
+      .check(bist_snk_ctl[2]),
+      .lfsr(bist_snk_ctl[1]),
+      .fifo_valid(fifo_ready[2]),
+      .fifo_read(bist_snk_read),
+      .fifo_data(fifo_fpc_data[3*DB-1:2*DB]),
+      .words(bist_snk_words),
+      .errors(bist_snk_errors),
+      .span(bist_snk_span)
+      );
+
    xadc xadc
      (
       .clock(clock),
@@ -192,6 +275,15 @@ module vna_dsp
      begin
 	if(seq_wvalid && seq_address == 0)
 	  seq_test <= seq_wdata;
+	seq_cycles <= seq_cycles + 1'b1;
+	bist_src_restart <= seq_wvalid && (seq_address == 16);
+	bist_snk_restart <= seq_wvalid && (seq_address == 18);
+	if(seq_wvalid && (seq_address == 16))
+	  bist_src_ctl <= seq_wdata[1:0];
+	if(seq_wvalid && (seq_address == 17))
+	  bist_src_seed <= seq_wdata;
+	if(seq_wvalid && (seq_address == 18))
+	  bist_snk_ctl <= seq_wdata[2:0];
 	seq_rdata1 <= seq_rdata0;
 	if(seq_rvalid)
 	  case(seq_address)
@@ -201,24 +293,27 @@ module vna_dsp
 	    3: seq_rdata0 <= 64'd3;
 	    4: seq_rdata0 <= seq_spidata;
 	    5: seq_rdata0 <= seq_xadcdata;
+	    6: seq_rdata0 <= seq_cycles;
    `ifdef USE_GT_DRP
 	    8: seq_rdata0 <= seq_gtdrpdata[0];
 	    9: seq_rdata0 <= seq_gtdrpdata[1];
 	    10: seq_rdata0 <= seq_gtdrpdata[2];
 	    11: seq_rdata0 <= seq_gtdrpdata[3];
    `endif
+	    16: seq_rdata0 <= bist_src_words;
+	    17: seq_rdata0 <= bist_src_span;
+	    18: seq_rdata0 <= bist_snk_words;
+	    19: seq_rdata0 <= bist_snk_errors;
+	    20: seq_rdata0 <= bist_snk_span;
 	    default: seq_rdata0 <= seq_address;
 	  endcase
 
-	count <= fifo_reset[6] ? 1'b0 : count + fifo_ready[6];
-	count_write <= fifo_ready[6];
 
 	if(fifo_ready[0])
 	  led[3:0] <= fpc_data[3:0];
-	fpc_read <= fifo_ready[4];
+	fpc_read <= fifo_ready[T];
 	tpc_write <= fifo_ready[0] && fpc_read;
 	tpc_data <= fpc_data;
-	null_read <= fifo_ready[2];
      end
 
    initial
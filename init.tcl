@@ -20,8 +20,8 @@ set_property -dict [list \
 			CONFIG.DSN_Enabled {false} \
 			CONFIG.en_ext_clk {false} \
 			CONFIG.mode_selection {Advanced} \
-			CONFIG.Bar0_Scale {Bytes} \
-			CONFIG.Bar0_Size {512} \
+			CONFIG.Bar0_Scale {Kilobytes} \
+			CONFIG.Bar0_Size {1} \
 			CONFIG.en_ext_ch_gt_drp {true} \
 		       ] [get_ips pcie_7x_0]
 
@@ -28,6 +28,14 @@
 #include <linux/cdev.h>
 #include <linux/ioctl.h>
 #include <linux/mm.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/dma-mapping.h>
+#include <linux/gfp.h>
 
 #define hififo_min(x,y) ((x) > (y) ? (y) : (x))
 
@@ -39,8 +47,14 @@
 #define IOC_INFO 0x10
 #define IOC_TIMEOUT 0x13
 #define IOC_BUILD 0x15
+#define IOC_TIMEOUT_NS 0x16
+#define IOC_COUNTERS 0x17
+#define IOC_COUNTERS_CLEAR 0x18
+#define IOC_MODERATION 0x19
+#define IOC_FLUSH 0x1A
+#define IOC_FRAMING 0x1B
 
-#define MAX_FIFOS 8
+#define MAX_FIFOS 64 /* up to 32 channels each way */
 
 static struct pci_device_id hififo_pci_table[] = {
   {VENDOR_ID, DEVICE_ID, PCI_ANY_ID, PCI_ANY_ID, 0, 0 ,0},
@@ -49,20 +63,53 @@ static struct pci_device_id hififo_pci_table[] = {
 
 #define BUFFER_SIZE (4 << 20)
 #define BUFFER_MASK (BUFFER_SIZE - 1)
+/* copies to and from the ring are at most this, overlapping with the DMA */
+#define COPY_GRANULE (64 << 10)
 
-#define REG_INTERRUPT 0
-#define REG_ID 1
+#define REG_INTERRUPT 0 /* from PC channels */
+#define REG_ID 1 /* from PC channels present */
 #define REG_BUILD 2
 #define REG_RESET 3
-#define REG_RESET_SET 3
+#define REG_RESET_SET 3 /* from PC in bits 31:0, to PC in 63:32 */
 #define REG_RESET_CLEAR 4
+#define REG_PERF_CLEAR 5
+#define REG_ID_TPC 5 /* read, to PC channels present */
+#define REG_INTERRUPT_TPC 6
+#define REG_CHANNELS 7 /* channels in each direction */
+#define REG_WORD 8 /* FIFO word bytes, transfers are a multiple of this */
+#define REG_TAGS 9 /* bit 0 extended tags on, bit 1 extended tags needed */
+#define REG_FIFO 64 /* FIFO n registers at REG_FIFO + n */
+#define REG_PERF 16 /* performance counters, see hififo.v */
+#define PERF_COUNT 48
+
+#define FPGA_CLOCK_MHZ 250
+#define MOD_TIMER_MAX ((1 << 24) - 1) /* cycles */
+#define MOD_WINDOW_NS 1000000 /* rate estimate window */
+
+/*
+ * Interrupt moderation, the card holds an interrupt until the FIFO has
+ * moved a threshold of bytes, tuned to about half the latency at the
+ * observed rate, or the latency has passed. 0 to interrupt on every match.
+ */
+static unsigned int irq_latency_us = 50;
+module_param(irq_latency_us, uint, 0644);
+MODULE_PARM_DESC(irq_latency_us, "maximum interrupt latency in us, 0 for no moderation");
+
+/*
+ * Rings from the coherent allocator are uncached on hosts without a
+ * coherent interconnect, the streaming DMA API gives cached pages with
+ * explicit syncs on the regions handed over
+ */
+static bool dma_streaming;
+module_param(dma_streaming, bool, 0444);
+MODULE_PARM_DESC(dma_streaming, "cached rings with streaming DMA syncs");
 
 #define writeqle(data, addr) (writeq(cpu_to_le64(data), addr))
 #define readlle(addr) (le32_to_cpu(readl(addr)))
 #define writereg(s, data, addr) (writeqle(data, &s->pio_reg_base[(addr)]))
 #define readreg(s, addr) (readlle(&s->pio_reg_base[(addr)]))
 
-#define IS_TO_PC(fifo) (((fifo)->n > (MAX_FIFOS/2)) ? 1 : 0)
+#define IS_TO_PC(fifo) ((fifo)->to_pc)
 #define DMA_DIRECTION(fifo) (IS_TO_PC(fifo) ? \
 			     PCI_DMA_FROMDEVICE : PCI_DMA_TODEVICE)
 
@@ -72,7 +119,10 @@ static int hififo_count; /* track the number of cards found */
 struct hififo_fifo {
 	dma_addr_t ring_dma_addr;
 	u64 *ring;
+	struct device *dev;
+	bool streaming; /* ring from alloc_pages, mapped with dma_map_single */
 	u64 *local_base;
+	u64 *pio_reg_base;
 	struct cdev cdev;
 	struct mutex sem;
 	u32 p_hw, p_sw;
@@ -80,17 +130,30 @@ struct hififo_fifo {
 	wait_queue_head_t queue;
 	spinlock_t lock_open;
 	int n; /* fifo number */
-	int timeout;
+	int to_pc;
+	int node; /* NUMA node of the card, -1 if unknown */
+	ktime_t timeout;
 	u32 build;
+	u32 word_bytes;
+	int nch; /* channels in each direction on the card */
+	u64 reset_mask; /* this FIFO's bit in REG_RESET_SET and CLEAR */
+	/* interrupt moderation */
+	u32 latency_us; /* for this file, from irq_latency_us on open */
+	u32 mod_threshold;
+	u32 mod_cycles;
+	u64 rate_bytes;
+	u64 rate_start;
 };
 
 struct hififo_dev {
 	struct hififo_fifo * fifo[MAX_FIFOS];
 	u64 *pio_reg_base;
 	int major;
+	int nch; /* channels in each direction */
 	int nfifos;
-	int idreg;
+	u32 idreg, idreg_tpc;
 	u32 build;
+	u32 word_bytes;
 };
 
 static inline void hififo_set_match(struct hififo_fifo *fifo, u32 v) {
@@ -111,6 +174,94 @@ static inline void hififo_set_abort(struct hififo_fifo *fifo, int enabled) {
 	writeqle(4 | (enabled ? (1<<8) : 0), fifo->local_base);
 }
 
+/* hold interrupts until threshold bytes have moved or cycles have passed */
+static inline void hififo_set_moderation(struct hififo_fifo *fifo,
+					 u32 threshold, u32 cycles) {
+	/* 5 is the command (3 lsbs), cycles in bits 63:40 */
+	writeqle(5 | threshold | ((u64) cycles << 40), fifo->local_base);
+	fifo->mod_threshold = threshold;
+	fifo->mod_cycles = cycles;
+}
+
+/* count bytes moved, retune the threshold from the rate once per window */
+static void hififo_moderate(struct hififo_fifo *fifo, size_t bytes)
+{
+	u64 now = ktime_get_ns();
+	u64 ns = now - fifo->rate_start;
+	u64 threshold;
+	u32 cycles;
+	fifo->rate_bytes += bytes;
+	if(ns < MOD_WINDOW_NS)
+		return;
+	cycles = hififo_min(fifo->latency_us * FPGA_CLOCK_MHZ, MOD_TIMER_MAX);
+	/* bytes per half latency = rate * latency / 2 */
+	threshold = div64_u64(fifo->rate_bytes * fifo->latency_us * 500, ns);
+	threshold = hififo_min(threshold, BUFFER_SIZE/8);
+	threshold &= ~((u64) fifo->word_bytes - 1);
+	if(fifo->latency_us == 0)
+		threshold = cycles = 0;
+	if((threshold != fifo->mod_threshold) || (cycles != fifo->mod_cycles))
+		hififo_set_moderation(fifo, threshold, cycles);
+	fifo->rate_bytes = 0;
+	fifo->rate_start = now;
+}
+
+static void hififo_ring_alloc(struct pci_dev *pdev, struct hififo_fifo *fifo)
+{
+	struct page *page;
+	fifo->dev = &pdev->dev;
+	fifo->streaming = dma_streaming;
+	if(!fifo->streaming){
+		/* the coherent allocator takes pages from dev_to_node() */
+		fifo->ring = pci_alloc_consistent(pdev,
+						  BUFFER_SIZE,
+						  &fifo->ring_dma_addr);
+		return;
+	}
+	page = alloc_pages_node(fifo->node, GFP_KERNEL | __GFP_NOWARN,
+				get_order(BUFFER_SIZE));
+	if(page == NULL)
+		return;
+	fifo->ring = page_address(page);
+	fifo->ring_dma_addr = dma_map_single(fifo->dev, fifo->ring,
+					     BUFFER_SIZE, DMA_DIRECTION(fifo));
+	if(dma_mapping_error(fifo->dev, fifo->ring_dma_addr)){
+		__free_pages(page, get_order(BUFFER_SIZE));
+		fifo->ring = NULL;
+	}
+}
+
+static void hififo_ring_free(struct pci_dev *pdev, struct hififo_fifo *fifo)
+{
+	if(fifo->ring == NULL)
+		return;
+	if(!fifo->streaming)
+		pci_free_consistent(pdev, BUFFER_SIZE, fifo->ring,
+				    fifo->ring_dma_addr);
+	else{
+		dma_unmap_single(fifo->dev, fifo->ring_dma_addr, BUFFER_SIZE,
+				 DMA_DIRECTION(fifo));
+		free_pages((unsigned long) fifo->ring, get_order(BUFFER_SIZE));
+	}
+	fifo->ring = NULL;
+}
+
+/* hand count bytes of the ring at offset to the CPU or back to the card */
+static inline void hififo_sync_cpu(struct hififo_fifo *fifo, u32 offset,
+				   size_t count) {
+	if(fifo->streaming)
+		dma_sync_single_for_cpu(fifo->dev, fifo->ring_dma_addr + offset,
+					count, DMA_DIRECTION(fifo));
+}
+
+static inline void hififo_sync_device(struct hififo_fifo *fifo, u32 offset,
+				      size_t count) {
+	if(fifo->streaming)
+		dma_sync_single_for_device(fifo->dev,
+					   fifo->ring_dma_addr + offset,
+					   count, DMA_DIRECTION(fifo));
+}
+
 static int hififo_release(struct inode *inode, struct file *filp)
 {
 	struct hififo_fifo *fifo = filp->private_data;
@@ -122,6 +273,45 @@ static int hififo_release(struct inode *inode, struct file *filp)
 	return 0;
 }
 
+/* start DMA from an empty ring, the FIFO must be aborted */
+static void hififo_restart(struct hififo_fifo *fifo)
+{
+	fifo->p_hw = 0;
+	fifo->p_sw = 0;
+	fifo->bytes_available = 0;
+	fifo->rate_bytes = 0;
+	fifo->rate_start = ktime_get_ns();
+	hififo_sync_device(fifo, 0, BUFFER_SIZE);
+	hififo_set_addr(fifo, fifo->ring_dma_addr);
+	wmb();
+	/* clear the abort bit on this FIFO in hardware */
+	hififo_set_abort(fifo, 0);
+}
+
+/*
+ * Discard everything in the ring and the FPGA FIFO and restart on the same
+ * file, returns the bytes the ring held
+ */
+static long hififo_flush(struct hififo_fifo *fifo)
+{
+	u32 p_hw = readlle(fifo->local_base);
+	u32 discarded = BUFFER_MASK & (IS_TO_PC(fifo) ?
+				       p_hw - fifo->p_sw : fifo->p_sw - p_hw);
+	hififo_set_abort(fifo, 1);
+	/*
+	 * as open and release, reads in flight must complete before the
+	 * reset, a late completion would match a reused tag
+	 */
+	udelay(100);
+	writeqle(fifo->reset_mask, &fifo->pio_reg_base[REG_RESET_SET]);
+	udelay(10);
+	writeqle(fifo->reset_mask, &fifo->pio_reg_base[REG_RESET_CLEAR]);
+	hififo_restart(fifo);
+	if(IS_TO_PC(fifo))
+		hififo_set_stop(fifo, fifo->p_sw + BUFFER_SIZE - 512);
+	return discarded;
+}
+
 static int hififo_open(struct inode *inode, struct file *filp)
 {
 	struct hififo_fifo *fifo = container_of(inode->i_cdev,
@@ -138,14 +328,11 @@ static int hififo_open(struct inode *inode, struct file *filp)
 		goto fail;
 	hififo_set_abort(fifo, 1);
 	udelay(100);
-	fifo->timeout = (250 * HZ) / 1000; /* default of 250 ms */
-	fifo->p_hw = 0;
-	fifo->p_sw = 0;
-	fifo->bytes_available = 0;
-	hififo_set_addr(fifo, fifo->ring_dma_addr);
-	wmb();
-	/* clear the abort bit on this FIFO in hardware */
-	hififo_set_abort(fifo, 0);
+	fifo->timeout = ms_to_ktime(250); /* default of 250 ms */
+	fifo->latency_us = hififo_min(irq_latency_us,
+				       MOD_TIMER_MAX / FPGA_CLOCK_MHZ);
+	hififo_set_moderation(fifo, 0, 0);
+	hififo_restart(fifo);
 	udelay(100);
 	if(IS_TO_PC(fifo))
 		hififo_set_stop(fifo, fifo->p_sw + BUFFER_SIZE - 512);
@@ -166,47 +353,67 @@ static bool hififo_ready_read(struct hififo_fifo *fifo, int count)
 	return (fifo->bytes_available >= count);
 }
 
+/* returns 0 if condition is met, -ETIME on timeout, -ERESTARTSYS on signal */
 #define hififo_wait(fifo, condition) \
-	wait_event_interruptible_timeout(fifo->queue, condition, fifo->timeout)
+	wait_event_interruptible_hrtimeout(fifo->queue, condition, fifo->timeout)
 
-static ssize_t hififo_read(struct file *filp,
-			   char *buf,
-			   size_t length,
-			   loff_t * offset)
+/* report a timeout or signal only if no data was transferred */
+static inline ssize_t hififo_status(size_t bytes_copied, int rc)
 {
-	struct hififo_fifo *fifo = filp->private_data;
+	if((bytes_copied != 0) || (rc == 0))
+		return bytes_copied;
+	return (rc == -ETIME) ? -ETIMEDOUT : rc;
+}
+
+/*
+ * read(2) and splice(2) to a pipe, which copies the ring to the pipe pages
+ * without passing through user memory
+ */
+static ssize_t hififo_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct hififo_fifo *fifo = iocb->ki_filp->private_data;
+	size_t length = iov_iter_count(to);
 	size_t bytes_copied = 0;
 	size_t csize;
 	ssize_t status;
+	int rc = 0;
 	printk(KERN_INFO DEVICE_NAME " %d: read, %zu\n", fifo->n, length);
-	if((buf == NULL) || ((length & 0x7F) != 0))
+	if((length & (fifo->word_bytes - 1)) != 0)
 		return -EINVAL;
 	status = mutex_lock_interruptible(&fifo->sem);
         if (status)
                 return status;
 	while(bytes_copied < length){
-		csize = hififo_min(BUFFER_SIZE/2, length - bytes_copied);
-		csize = hififo_min(csize, BUFFER_SIZE - fifo->p_sw);
-		// wait for DMA data
-		hififo_set_stop(fifo, fifo->p_sw + BUFFER_SIZE - 512);
-		hififo_set_match(fifo, fifo->p_sw + csize);
-		wmb();
-		if( hififo_wait(fifo, hififo_ready_read(fifo, csize)) < 1 ){
-			printk(KERN_INFO DEVICE_NAME " %d: rtimeout\n", fifo->n);
-			break;
+		// wait for a granule of DMA data, or the rest of the read
+		csize = hififo_min(COPY_GRANULE, length - bytes_copied);
+		if(!hififo_ready_read(fifo, csize)){
+			hififo_set_match(fifo, fifo->p_sw + csize);
+			wmb();
+			rc = hififo_wait(fifo, hififo_ready_read(fifo, csize));
+			if(rc != 0){
+				printk(KERN_INFO DEVICE_NAME " %d: rtimeout\n", fifo->n);
+				break;
+			}
 		}
-		if(copy_to_user(&buf[bytes_copied],
-				fifo->ring + fifo->p_sw/8, csize) != 0){
+		csize = hififo_min(csize, fifo->bytes_available);
+		csize = hififo_min(csize, BUFFER_SIZE - fifo->p_sw);
+		hififo_sync_cpu(fifo, fifo->p_sw, csize);
+		if(copy_to_iter(fifo->ring + fifo->p_sw/8, csize, to) != csize){
 			printk(KERN_INFO DEVICE_NAME " %d: rcfail\n", fifo->n);
+			rc = -EFAULT;
 			break;
 		}
+		hififo_sync_device(fifo, fifo->p_sw, csize);
 		fifo->p_sw += csize;
 		fifo->p_sw &= BUFFER_MASK;
+		// return the space to the DMA as soon as it is copied
+		hififo_set_stop(fifo, fifo->p_sw + BUFFER_SIZE - 512);
 		fifo->bytes_available -= csize;
 		bytes_copied += csize;
+		hififo_moderate(fifo, csize);
 	}
 	mutex_unlock(&fifo->sem);
-	return bytes_copied;
+	return hififo_status(bytes_copied, rc);
 }
 
 /* Returns 1 if the FIFO contains at least count bytes, 0 otherwise */
@@ -221,41 +428,52 @@ static bool hififo_ready_write(struct hififo_fifo *fifo, int count)
 	return (fifo->bytes_available >= count);
 }
 
-static ssize_t hififo_write(struct file *filp, const char *buf, size_t length,
-			    loff_t * off)
+/* write(2) and splice(2) from a pipe */
+static ssize_t hififo_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-	struct hififo_fifo *fifo = filp->private_data;
+	struct hififo_fifo *fifo = iocb->ki_filp->private_data;
+	size_t length = iov_iter_count(from);
 	size_t bytes_copied = 0, csize;
 	ssize_t status;
+	int rc = 0;
 	printk(KERN_INFO DEVICE_NAME " %d: write, %zu\n", fifo->n, length);
-	if((buf == NULL) || ((length & 0x1FF) != 0))
+	if((length & (fifo->word_bytes - 1)) != 0)
 		return -EINVAL;
 	status = mutex_lock_interruptible(&fifo->sem);
         if (status)
                 return status;
 	while(bytes_copied < length){
-		csize = hififo_min(BUFFER_SIZE/2, length - bytes_copied);
-		csize = hififo_min(csize, BUFFER_SIZE - fifo->p_sw);
-		hififo_set_match(fifo, fifo->p_sw + csize + 512 - BUFFER_SIZE);
-		wmb();
-		if( hififo_wait(fifo, hififo_ready_write(fifo, csize)) < 1 ){
-			printk(KERN_INFO DEVICE_NAME " %d: wtimeout\n", fifo->n);
-			break;
+		// wait for a granule of space, or the rest of the write
+		csize = hififo_min(COPY_GRANULE, length - bytes_copied);
+		if(!hififo_ready_write(fifo, csize)){
+			hififo_set_match(fifo, fifo->p_sw + csize + 512 - BUFFER_SIZE);
+			wmb();
+			rc = hififo_wait(fifo, hififo_ready_write(fifo, csize));
+			if(rc != 0){
+				printk(KERN_INFO DEVICE_NAME " %d: wtimeout\n", fifo->n);
+				break;
+			}
 		}
-		if(copy_from_user
-		   (fifo->ring + fifo->p_sw/8, &buf[bytes_copied], csize) != 0){
+		csize = hififo_min(csize, fifo->bytes_available);
+		csize = hififo_min(csize, BUFFER_SIZE - fifo->p_sw);
+		// the CPU does not read the ring back, keep it out of the cache
+		if(copy_from_iter_nocache(fifo->ring + fifo->p_sw/8,
+					  csize, from) != csize){
 			printk(KERN_INFO DEVICE_NAME " %d: wcfail\n", fifo->n);
+			rc = -EFAULT;
 			break;
 		}
+		hififo_sync_device(fifo, fifo->p_sw, csize);
 		fifo->p_sw += csize;
 		fifo->p_sw &= BUFFER_MASK;
 		hififo_set_stop(fifo, fifo->p_sw);
 		fifo->bytes_available -= csize;
 		wmb();
 		bytes_copied += csize;
+		hififo_moderate(fifo, csize);
 	}
 	mutex_unlock(&fifo->sem);
-	return bytes_copied;
+	return hififo_status(bytes_copied, rc);
 }
 
 static long hififo_ioctl (struct file *file,
@@ -268,42 +486,107 @@ static long hififo_ioctl (struct file *file,
                 return status;
 	status = -ENOTTY;
 	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_TIMEOUT)){
-		/* 1 extra jiffy so we round up rather than down */
-		fifo->timeout = 1 + (arg * HZ) / 1000;
+		fifo->timeout = ms_to_ktime(arg);
+		status = 0;
+	}
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_TIMEOUT_NS)){
+		fifo->timeout = ns_to_ktime(arg);
 		status = 0;
 	}
 	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_BUILD))
 		status = (long) fifo->build;
+	/* returns the bytes discarded from the ring */
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_FLUSH))
+		status = hififo_flush(fifo);
+	/*
+	 * to PC frames of arg FIFO words, 0 for none, see hififo_framer.v.
+	 * Takes effect at the FIFO reset of a flush, returns as IOC_FLUSH.
+	 */
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_FRAMING)){
+		if(!IS_TO_PC(fifo) || (arg > 0xFFFF))
+			status = -EINVAL;
+		else{
+			/* 6 is the command (3 lsbs), bit 8 enable */
+			writeqle(6 | (arg ? (1<<8) : 0) | ((u64) arg << 16),
+				 fifo->local_base);
+			status = hififo_flush(fifo);
+		}
+	}
+	/* maximum interrupt latency in us for this file, 0 for none */
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_MODERATION)){
+		fifo->latency_us = hififo_min(arg, MOD_TIMER_MAX / FPGA_CLOCK_MHZ);
+		fifo->rate_bytes = 0;
+		fifo->rate_start = ktime_get_ns();
+		if(fifo->latency_us == 0)
+			hififo_set_moderation(fifo, 0, 0);
+		status = 0;
+	}
+	/* arg points to u32[PERF_COUNT], returns the count */
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_COUNTERS)){
+		u32 counters[PERF_COUNT];
+		int i;
+		for(i=0; i<PERF_COUNT; i++)
+			counters[i] = readlle(&fifo->pio_reg_base[REG_PERF+i]);
+		if(copy_to_user((void __user *) arg, counters, sizeof(counters)))
+			status = -EFAULT;
+		else
+			status = PERF_COUNT;
+	}
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_COUNTERS_CLEAR)){
+		writeqle(0, &fifo->pio_reg_base[REG_PERF_CLEAR]);
+		status = 0;
+	}
+	/*
+	 * bits 7:0 fifo number, bit 8 to PC, bits 15:12 log2 of the FIFO
+	 * word bytes, bits 23:16 NUMA node + 1, bits 29:24 channels each way
+	 */
+	if(command == _IO(HIFIFO_IOC_MAGIC, IOC_INFO))
+		status = fifo->n | (IS_TO_PC(fifo) << 8) |
+			(ilog2(fifo->word_bytes) << 12) |
+			(((fifo->node + 1) & 0xFF) << 16) |
+			(fifo->nch << 24);
 	mutex_unlock(&fifo->sem);
 	return status;
 }
 
 static struct file_operations fops_tpc = {
-	.read = hififo_read,
+	.read_iter = hififo_read_iter,
+	.splice_read = generic_file_splice_read,
 	.unlocked_ioctl = hififo_ioctl,
 	.open = hififo_open,
 	.release = hififo_release
 };
 
 static struct file_operations fops_fpc = {
-	.write = hififo_write,
+	.write_iter = hififo_write_iter,
+	.splice_write = iter_file_splice_write,
 	.unlocked_ioctl = hififo_ioctl,
 	.open = hififo_open,
 	.release = hififo_release
 };
 
+static ssize_t numa_node_show(struct device *dev,
+			      struct device_attribute *attr,
+			      char *buf)
+{
+	struct hififo_fifo *fifo = dev_get_drvdata(dev);
+	return sprintf(buf, "%d\n", fifo->node);
+}
+
+static DEVICE_ATTR_RO(numa_node);
+
 static irqreturn_t hififo_interrupt(int irq, void *dev_id, struct pt_regs *regs)
 {
 	struct hififo_dev *drvdata = dev_id;
 	u32 sr = readreg(drvdata, REG_INTERRUPT);
+	u32 sr_tpc = readreg(drvdata, REG_INTERRUPT_TPC);
 	int i;
-	//printk(KERN_INFO DEVICE_NAME " interrupt: sr = %x\n", sr);
-	for(i=0; i<MAX_FIFOS; i++){
-		if(!(sr & (1<<i)))
-			continue;
-		if(drvdata->fifo[i] == NULL)
-			continue;
-		wake_up_all(&drvdata->fifo[i]->queue);
+	//printk(KERN_INFO DEVICE_NAME " interrupt: sr = %x %x\n", sr, sr_tpc);
+	for(i=0; i<drvdata->nch; i++){
+		if((sr & (1U<<i)) && (drvdata->fifo[i] != NULL))
+			wake_up_all(&drvdata->fifo[i]->queue);
+		if((sr_tpc & (1U<<i)) && (drvdata->fifo[drvdata->nch+i] != NULL))
+			wake_up_all(&drvdata->fifo[drvdata->nch+i]->queue);
 	}
 	return IRQ_HANDLED;
 }
@@ -316,6 +599,8 @@ static int hififo_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	char tmpstr[16];
 	struct hififo_dev *drvdata;
 	struct hififo_fifo * fifo;
+	struct device * fifo_dev;
+	int node = dev_to_node(&pdev->dev);
 
 	drvdata = devm_kzalloc(&pdev->dev,
 			       sizeof(struct hififo_dev),
@@ -372,25 +657,63 @@ static int hififo_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	for(i=0; i<8; i++)
 		printk("bar0[%d] = %.8x\n", i, (u32) readreg(drvdata, i));
+	drvdata->nch = readreg(drvdata, REG_CHANNELS);
 	drvdata->idreg = readreg(drvdata, REG_ID);
+	drvdata->idreg_tpc = readreg(drvdata, REG_ID_TPC);
 	drvdata->build = readreg(drvdata, REG_BUILD);
+	drvdata->word_bytes = readreg(drvdata, REG_WORD);
+	if(drvdata->word_bytes == 0) /* older builds, 64 bit only */
+		drvdata->word_bytes = 8;
 	printk(KERN_INFO DEVICE_NAME " FPGA build = 0x%.8X\n", drvdata->build);
-	drvdata->nfifos = 0;
-	for(i=0; i<MAX_FIFOS; i++){
-		if(drvdata->idreg & (1 << i))
-			drvdata->nfifos ++;
+	printk(KERN_INFO DEVICE_NAME " NUMA node = %d\n", node);
+	printk(KERN_INFO DEVICE_NAME " %d channels each way\n", drvdata->nch);
+	printk(KERN_INFO DEVICE_NAME " %d byte FIFO words\n", drvdata->word_bytes);
+	printk(KERN_INFO DEVICE_NAME " %s DMA rings\n",
+	       dma_streaming ? "streaming" : "coherent");
+
+	/* older bitstreams have no channel count register */
+	if((drvdata->nch < 1) || (drvdata->nch > MAX_FIFOS/2)){
+		printk(KERN_ERR DEVICE_NAME ": unsupported FPGA build\n");
+		return -ENODEV;
+	}
+
+	/* the FIFO registers follow the first 64 qwords, BAR0 is 1 KB */
+	if(pci_resource_len(pdev, 0) < (REG_FIFO + 2*drvdata->nch) * 8){
+		printk(KERN_ERR DEVICE_NAME ": BAR0 too small for %d channels\n",
+		       drvdata->nch);
+		return -ENODEV;
 	}
 
-	if(drvdata->nfifos == 0){
+	if((drvdata->idreg | drvdata->idreg_tpc) == 0){
 		printk(KERN_INFO DEVICE_NAME "no fifos reported on card\n");
 		return -1;
 	}
 
+	/*
+	 * more than 8 from PC FIFOs share the read tags only with extended
+	 * tags, enable them if the host has not, the FIFOs stall without
+	 */
+	if(readreg(drvdata, REG_TAGS) & 2){
+		u32 devcap = 0;
+		pcie_capability_read_dword(pdev, PCI_EXP_DEVCAP, &devcap);
+		if(devcap & PCI_EXP_DEVCAP_EXT_TAG)
+			pcie_capability_set_word(pdev, PCI_EXP_DEVCTL,
+						 PCI_EXP_DEVCTL_EXT_TAG);
+		if((readreg(drvdata, REG_TAGS) & 1) == 0){
+			printk(KERN_ERR DEVICE_NAME
+			       ": %d channels need PCIe extended tags\n",
+			       drvdata->nch);
+			return -ENODEV;
+		}
+	}
+
 	/* reset it */
-	writereg(drvdata, 0xFFFF, REG_RESET_SET);
+	writereg(drvdata, ~0ULL, REG_RESET_SET);
 	udelay(10); /* wait for completion of anything that was running */
-	writereg(drvdata, 0xFFFF, REG_RESET_CLEAR);
+	writereg(drvdata, ~0ULL, REG_RESET_CLEAR);
 
+	/* minor n is FIFO n, including any not present */
+	drvdata->nfifos = 2 * drvdata->nch;
 	rc = alloc_chrdev_region(&dev, 0, drvdata->nfifos, DEVICE_NAME);
 	if (rc) {
 		printk(KERN_ERR DEVICE_NAME ": alloc_chrdev_region() failed\n");
@@ -399,8 +722,10 @@ static int hififo_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	drvdata->major = MAJOR(dev);
 
-	for(i=0; i<MAX_FIFOS; i++){
-		if((drvdata->idreg & (1 << i)) == 0)
+	for(i=0; i<drvdata->nfifos; i++){
+		int to_pc = i >= drvdata->nch;
+		u32 present = to_pc ? drvdata->idreg_tpc : drvdata->idreg;
+		if((present & (1U << (i % drvdata->nch))) == 0)
 			continue; /* fifo not present */
 		fifo = devm_kzalloc(&pdev->dev,
 				    sizeof(struct hififo_fifo),
@@ -411,7 +736,7 @@ static int hififo_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 			return -ENOMEM;
 		}
 		drvdata->fifo[i] = fifo;
-		if(i<MAX_FIFOS/2){
+		if(!to_pc){
 			cdev_init(&fifo->cdev, &fops_fpc); /* returns void */
 			fifo->cdev.ops = &fops_fpc;
 		}
@@ -429,20 +754,27 @@ static int hififo_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 			return rc;
 		}
 		sprintf(tmpstr, "hififo_%d_%d", hififo_count, i);
-		device_create(hififo_class,
-			      NULL,
-			      MKDEV(MAJOR(dev), i),
-			      NULL,
-			      tmpstr);
+		fifo_dev = device_create(hififo_class,
+					 &pdev->dev,
+					 MKDEV(MAJOR(dev), i),
+					 fifo,
+					 tmpstr);
+		if(!IS_ERR(fifo_dev))
+			device_create_file(fifo_dev, &dev_attr_numa_node);
 		fifo->n = i;
+		fifo->to_pc = to_pc;
+		fifo->reset_mask = to_pc ? 1ULL << (32 + i - drvdata->nch) :
+			1ULL << i;
+		fifo->node = node;
 		spin_lock_init(&fifo->lock_open);
-		fifo->local_base = drvdata->pio_reg_base+8+i;
+		fifo->local_base = drvdata->pio_reg_base+REG_FIFO+i;
+		fifo->pio_reg_base = drvdata->pio_reg_base;
 		init_waitqueue_head(&fifo->queue);
 		fifo->build = drvdata->build;
+		fifo->word_bytes = drvdata->word_bytes;
+		fifo->nch = drvdata->nch;
 		mutex_init(&fifo->sem);
-		fifo->ring = pci_alloc_consistent(pdev,
-						  BUFFER_SIZE,
-						  &fifo->ring_dma_addr);
+		hififo_ring_alloc(pdev, fifo);
 	}
 	hififo_count++;
 	/* enable interrupts */
@@ -453,16 +785,11 @@ static int hififo_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 static void hififo_remove(struct pci_dev *pdev){
 	struct hififo_dev *drvdata = pci_get_drvdata(pdev);
 	int i;
-	writereg(drvdata, 0xFF, REG_RESET_SET);
-	for(i=0; i<MAX_FIFOS; i++){
+	writereg(drvdata, ~0ULL, REG_RESET_SET);
+	for(i=0; i<drvdata->nfifos; i++){
 		if(drvdata->fifo[i] == NULL)
 			continue;
-		if(drvdata->fifo[i]->ring != NULL)
-			pci_free_consistent(pdev,
-					    BUFFER_SIZE,
-					    drvdata->fifo[i]->ring,
-					    drvdata->fifo[i]->ring_dma_addr);
-		drvdata->fifo[i]->ring = NULL;
+		hififo_ring_free(pdev, drvdata->fifo[i]);
 		device_destroy(hififo_class, MKDEV(drvdata->major, i));
 	}
 	unregister_chrdev_region (MKDEV(drvdata->major, 0), drvdata->nfifos);
@@ -0,0 +1,235 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "TimeIt.h"
+#include "Broadcast.h"
+
+using namespace std;
+
+#define BROADCAST_MAGIC 0x4849464946304243 // "HIFIFOBC"
+#define HEADER_SIZE 4096 // ring header, the slots follow
+
+static_assert(sizeof(broadcast_ring) <= HEADER_SIZE, "broadcast header too big");
+
+// consumer states
+#define C_FREE 0
+#define C_ACTIVE 1
+#define C_DROPPED 2
+#define C_CLAIMING 3
+
+BroadcastProducer::BroadcastProducer(Hififo * fifo, const char * name,
+				     size_t block_size, size_t nslots,
+				     broadcast_policy policy)
+{
+	if((block_size == 0) || ((block_size & 511) != 0) || (nslots < 2))
+		throw std::runtime_error( "broadcast: bad block size or slot count" );
+	this->fifo = fifo;
+	snprintf(this->name, sizeof(this->name), "/%s", name);
+	map_size = HEADER_SIZE + block_size * nslots;
+	int fd = shm_open(this->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if(fd < 0){
+		perror(this->name);
+		throw std::runtime_error( "broadcast shm_open failed" );
+	}
+	if(ftruncate(fd, map_size) != 0){
+		close(fd);
+		shm_unlink(this->name);
+		throw std::runtime_error( "broadcast ftruncate failed" );
+	}
+	void *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED){
+		shm_unlink(this->name);
+		throw std::runtime_error( "broadcast mmap failed" );
+	}
+	ring = (broadcast_ring *) p;
+	slots = (char *) p + HEADER_SIZE;
+	memset((void *) ring, 0, sizeof(broadcast_ring));
+	ring->block_size = block_size;
+	ring->nslots = nslots;
+	ring->policy = policy;
+	ring->magic = BROADCAST_MAGIC;
+	throttled = 0;
+	stopping = false;
+}
+
+BroadcastProducer::~BroadcastProducer()
+{
+	ring->closed = 1;
+	munmap(ring, map_size);
+	shm_unlink(name);
+}
+
+void BroadcastProducer::stop()
+{
+	stopping = true;
+}
+
+/* make sure no consumer still needs the slot block seq is going into */
+/* false if stopped while throttled, slot seq is still held */
+bool BroadcastProducer::make_room(uint64_t seq)
+{
+	if(seq < ring->nslots)
+		return true;
+	for(int i=0; i<BROADCAST_MAX_CONSUMERS; i++){
+		broadcast_consumer & c = ring->consumer[i];
+		while(((c.state == C_ACTIVE) || (c.state == C_DROPPED))
+		      && (c.cursor + ring->nslots <= seq)){
+			// a lagging consumer that has gone away frees its entry
+			if((kill(c.pid, 0) != 0) && (errno == ESRCH)){
+				c.state = C_FREE;
+				break;
+			}
+			if(c.state == C_DROPPED)
+				break;
+			if(ring->policy == BROADCAST_DROP){
+				c.state = C_DROPPED;
+				break;
+			}
+			if(stopping)
+				return false;
+			throttled++;
+			usleep(50);
+		}
+	}
+	return true;
+}
+
+/* publish bytes from the FIFO, 0 to run until stop() or a timeout */
+void BroadcastProducer::run(uint64_t bytes)
+{
+	uint64_t bs = ring->block_size;
+	uint64_t end = bytes / bs;
+	for(uint64_t seq = ring->head; !stopping && ((bytes == 0) || (seq < end)); seq++){
+		if(!make_room(seq))
+			break;
+		ring->writing = seq;
+		try{
+			fifo->bread(slots + (seq % ring->nslots) * bs, bs);
+		}
+		catch(const std::runtime_error & e){
+			cerr << "broadcast: " << e.what() << "\n";
+			break;
+		}
+		ring->head = seq + 1;
+	}
+}
+
+BroadcastConsumer::BroadcastConsumer(const char * name)
+{
+	char shm_name[64];
+	snprintf(shm_name, sizeof(shm_name), "/%s", name);
+	int fd = shm_open(shm_name, O_RDWR, 0);
+	if(fd < 0){
+		perror(shm_name);
+		throw std::runtime_error( "broadcast consumer shm_open failed" );
+	}
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size < HEADER_SIZE)){
+		close(fd);
+		throw std::runtime_error( "broadcast consumer: bad ring" );
+	}
+	map_size = st.st_size;
+	void *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+		throw std::runtime_error( "broadcast consumer mmap failed" );
+	ring = (broadcast_ring *) p;
+	slots = (char *) p + HEADER_SIZE;
+	if(ring->magic != BROADCAST_MAGIC){
+		munmap(p, map_size);
+		throw std::runtime_error( "broadcast consumer: bad ring" );
+	}
+	for(index=0; index<BROADCAST_MAX_CONSUMERS; index++){
+		int expected = C_FREE;
+		if(ring->consumer[index].state.compare_exchange_strong(expected, C_CLAIMING))
+			break;
+	}
+	if(index == BROADCAST_MAX_CONSUMERS){
+		munmap(p, map_size);
+		throw std::runtime_error( "broadcast consumer: too many consumers" );
+	}
+	broadcast_consumer & c = ring->consumer[index];
+	c.pid = getpid();
+	c.lost = 0;
+	c.cursor = ring->head.load();
+	c.state = C_ACTIVE;
+	seq = c.cursor;
+}
+
+BroadcastConsumer::~BroadcastConsumer()
+{
+	ring->consumer[index].state = C_FREE;
+	munmap(ring, map_size);
+}
+
+size_t BroadcastConsumer::block_size()
+{
+	return ring->block_size;
+}
+
+uint64_t BroadcastConsumer::lost()
+{
+	return ring->consumer[index].lost;
+}
+
+/*
+ * Returns the next block, read in place in the ring, or NULL on timeout
+ * or when the producer has closed. Call done() when finished with it.
+ */
+const void * BroadcastConsumer::next(double timeout)
+{
+	broadcast_consumer & c = ring->consumer[index];
+	if(c.state == C_DROPPED){
+		// fell a ring behind, skip to the newest data
+		uint64_t head = ring->head;
+		c.lost += head - c.cursor;
+		c.cursor = head;
+		c.state = C_ACTIVE;
+	}
+	seq = c.cursor;
+	TimeIt timer{};
+	for(int spins = 0; ring->head <= seq; spins++){
+		if(ring->closed || (timer.elapsed() > timeout))
+			return NULL;
+		if(spins > 1000)
+			usleep(20);
+	}
+	return slots + (seq % ring->nslots) * ring->block_size;
+}
+
+/* returns false if the producer overwrote the block while it was in use */
+bool BroadcastConsumer::done()
+{
+	broadcast_consumer & c = ring->consumer[index];
+	bool ok = ring->writing < seq + ring->nslots;
+	if(c.state == C_ACTIVE)
+		c.cursor = seq + 1;
+	return ok;
+}
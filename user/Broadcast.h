@@ -0,0 +1,94 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include "Hififo.h"
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Fan out of one to PC stream to several local processes. The producer
+ * owns the FIFO and reads blocks straight into a ring in POSIX shared
+ * memory (/dev/shm/<name>). Consumers map the ring and read the blocks
+ * in place, each with its own cursor, so an extra consumer costs nothing
+ * on the device side.
+ *
+ * A consumer falling a whole ring behind is either dropped (it resyncs
+ * to the newest block and counts the loss) or throttles the producer,
+ * depending on the policy.
+ */
+
+#define BROADCAST_MAX_CONSUMERS 16
+
+enum broadcast_policy {
+	BROADCAST_DROP = 0,
+	BROADCAST_THROTTLE = 1
+};
+
+struct broadcast_consumer {
+	std::atomic<uint64_t> cursor; // next block to be read
+	std::atomic<int> state; // 0: free, 1: active, 2: dropped
+	std::atomic<int> pid;
+	std::atomic<uint64_t> lost; // blocks lost to being dropped
+};
+
+struct broadcast_ring {
+	uint64_t magic;
+	uint64_t block_size;
+	uint64_t nslots;
+	int policy;
+	std::atomic<uint64_t> head; // blocks published
+	std::atomic<uint64_t> writing; // block being written
+	std::atomic<int> closed;
+	broadcast_consumer consumer[BROADCAST_MAX_CONSUMERS];
+};
+
+class BroadcastProducer {
+private:
+	Hififo * fifo;
+	char name[64];
+	broadcast_ring * ring;
+	char * slots;
+	size_t map_size;
+	std::atomic<bool> stopping;
+	bool make_room(uint64_t seq);
+public:
+	BroadcastProducer(Hififo * fifo, const char * name, size_t block_size,
+			  size_t nslots = 64, broadcast_policy policy = BROADCAST_DROP);
+	~BroadcastProducer();
+	void run(uint64_t bytes = 0);
+	void stop();
+	uint64_t throttled; // times the producer waited for a consumer
+};
+
+class BroadcastConsumer {
+private:
+	broadcast_ring * ring;
+	char * slots;
+	size_t map_size;
+	int index;
+	uint64_t seq; // block returned by next()
+public:
+	BroadcastConsumer(const char * name);
+	~BroadcastConsumer();
+	const void * next(double timeout = 1.0);
+	bool done();
+	size_t block_size();
+	uint64_t lost();
+};
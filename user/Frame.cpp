@@ -0,0 +1,153 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "Frame.h"
+#include "Trace.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define FRAME_SSE42
+#endif
+
+using namespace std;
+
+static_assert(sizeof(hififo_frame_header) == 16, "frame header layout");
+
+#define CRC32C_POLY 0x82F63B78 // reflected
+
+struct crc32c_table {
+	uint32_t t[256];
+	crc32c_table() {
+		for(uint32_t i=0; i<256; i++){
+			uint32_t c = i;
+			for(int j=0; j<8; j++)
+				c = (c >> 1) ^ ((c & 1) ? CRC32C_POLY : 0);
+			t[i] = c;
+		}
+	}
+};
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t count)
+{
+	static const crc32c_table table;
+	for(size_t i=0; i<count; i++)
+		crc = table.t[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef FRAME_SSE42
+// a qword per crc32 instruction, the same CRC as the framer
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t count)
+{
+	uint64_t c = crc;
+	for(size_t i=0; i<count; i+=8){
+		uint64_t q;
+		memcpy(&q, p + i, 8);
+		c = _mm_crc32_u64(c, q);
+	}
+	return c;
+}
+#endif
+
+uint32_t crc32c(const void *buf, size_t count)
+{
+	const uint8_t *p = (const uint8_t *) buf;
+#ifdef FRAME_SSE42
+	static const bool sse42 = __builtin_cpu_supports("sse4.2");
+	if(sse42)
+		return ~crc32c_hw(~0U, p, count);
+#endif
+	return ~crc32c_sw(~0U, p, count);
+}
+
+FrameChecker::FrameChecker(size_t word_bytes, size_t words)
+{
+	if((words == 0) || (words > 0xFFFF))
+		throw std::runtime_error( "frame length must be 1 to 65535 words" );
+	word = word_bytes;
+	this->words = words;
+	clear();
+}
+
+size_t FrameChecker::frame_bytes()
+{
+	return sizeof(hififo_frame_header) + data_bytes() + word;
+}
+
+size_t FrameChecker::data_bytes()
+{
+	return words * word;
+}
+
+size_t FrameChecker::check(const void *buf, size_t count, const char **data)
+{
+	TRACE_SCOPE("frame check");
+	const char *p = (const char *) buf;
+	size_t n = count / frame_bytes();
+	size_t good = 0;
+	for(size_t i=0; i<n; i++, p += frame_bytes()){
+		const hififo_frame_header *h = (const hififo_frame_header *) p;
+		const char *d = p + sizeof(hififo_frame_header);
+		if(data != NULL)
+			data[i] = NULL;
+		errors.frames++;
+		// a bad frame still takes its place in the sequence
+		if((h->magic != FRAME_MAGIC) || (h->words != words)){
+			errors.bad_headers++;
+			next_seq++;
+			continue;
+		}
+		uint32_t trailer;
+		memcpy(&trailer, d + data_bytes(), 4);
+		if(crc32c(p, sizeof(hififo_frame_header) + data_bytes()) != trailer){
+			errors.crc_errors++;
+			next_seq++;
+			continue;
+		}
+		if(synced && (h->seq != next_seq))
+			errors.lost += h->seq - next_seq;
+		next_seq = h->seq + 1;
+		synced = true;
+		if(data != NULL)
+			data[i] = d;
+		good++;
+	}
+	return good;
+}
+
+void FrameChecker::clear()
+{
+	memset(&errors, 0, sizeof(errors));
+	synced = false;
+	next_seq = 0;
+}
+
+void FrameChecker::report(const char *name)
+{
+	cerr << name << ": " << errors.frames << " frames, "
+	     << errors.bad_headers << " bad headers, "
+	     << errors.crc_errors << " CRC errors, "
+	     << errors.lost << " lost\n";
+}
@@ -0,0 +1,69 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Framed to PC streams, see hdl/hififo_framer.v and Hififo::set_framing.
+ * A frame is this header, words FIFO words of data and a FIFO word
+ * trailer holding the CRC32C of the header and data in its low 32 bits.
+ * Frames are a whole number of FIFO words, so a read of a multiple of
+ * frame_bytes() from a freshly framed stream is a whole number of frames.
+ */
+
+#define FRAME_MAGIC 0x4648
+
+struct hififo_frame_header {
+	uint16_t magic;
+	uint16_t words; // FIFO words of data
+	uint32_t seq;
+	uint64_t timestamp; // FPGA FIFO clock cycles at the first data word
+};
+
+struct frame_errors {
+	uint64_t frames; // frames checked
+	uint64_t bad_headers; // wrong magic or length
+	uint64_t crc_errors;
+	uint64_t lost; // frames missing from the sequence, not counting bad ones
+};
+
+// CRC32C as computed by the framer, count a multiple of 8
+uint32_t crc32c(const void *buf, size_t count);
+
+class FrameChecker {
+private:
+	size_t word; // FIFO word bytes
+	size_t words;
+	uint32_t next_seq;
+	bool synced;
+public:
+	frame_errors errors;
+	FrameChecker(size_t word_bytes, size_t words);
+	size_t frame_bytes();
+	size_t data_bytes();
+	/*
+	 * checks the count / frame_bytes() frames in buf, data[i] is set to
+	 * frame i's data, or NULL if the frame is bad. Returns the good frames.
+	 */
+	size_t check(const void *buf, size_t count, const char **data = NULL);
+	void clear();
+	void report(const char *name);
+};
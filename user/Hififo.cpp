@@ -16,8 +16,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <iostream>
@@ -25,6 +30,7 @@
 #include <ctime>
 
 #include "Hififo.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -34,21 +40,121 @@ using namespace std;
 #define IOC_TIMEOUT 0x13
 #define IOC_AVAILABLE 0x14
 #define IOC_FPGABUILD 0x15
+#define IOC_TIMEOUT_NS 0x16
+#define IOC_COUNTERS 0x17
+#define IOC_COUNTERS_CLEAR 0x18
+#define IOC_MODERATION 0x19
+#define IOC_FLUSH 0x1A
+#define IOC_FRAMING 0x1B
 
+static_assert(sizeof(hififo_counters) == 48*4, "hififo counter layout");
+
+/* timeout in seconds, resolved to the nanosecond */
 void Hififo::set_timeout(double timeout)
 {
-	unsigned long ultimeout = (unsigned long) (1000*timeout);
-	if(ioctl(fd, _IO('f', IOC_TIMEOUT), ultimeout) != 0)
+	unsigned long ns = (unsigned long) (1e9*timeout + 0.5);
+	if(ioctl(fd, _IO('f', IOC_TIMEOUT_NS), ns) == 0)
+		return;
+	// older drivers only take milliseconds
+	unsigned long ms = (ns + 999999) / 1000000;
+	if(ioctl(fd, _IO('f', IOC_TIMEOUT), ms) != 0)
 		throw std::runtime_error( "hififo set timeout failed" );
 }
 
+/*
+ * maximum interrupt latency in seconds, resolved to the microsecond, 0 to
+ * interrupt as soon as a transfer can complete
+ */
+void Hififo::set_moderation(double latency)
+{
+	unsigned long us = (unsigned long) (1e6*latency + 0.5);
+	if(ioctl(fd, _IO('f', IOC_MODERATION), us) != 0)
+		throw std::runtime_error( "hififo set moderation failed" );
+}
+
+/*
+ * discard the data in flight and restart the stream on the same file,
+ * returns the bytes discarded from the host ring
+ */
+size_t Hififo::flush()
+{
+	long rc = ioctl(fd, _IO('f', IOC_FLUSH), 0);
+	if(rc < 0)
+		throw std::runtime_error( "hififo flush failed" );
+	return rc;
+}
+
+void Hififo::set_framing(size_t words)
+{
+	if(ioctl(fd, _IO('f', IOC_FRAMING), words) < 0)
+		throw std::runtime_error( "hififo set framing failed" );
+}
+
 char * Hififo::get_fpga_build_time()
 {
 	time_t ts = (time_t) ioctl(fd, _IO('f', IOC_FPGABUILD), 0);
 	return asctime(localtime(&ts));
 }
 
-Hififo::Hififo(const char * filename)
+void Hififo::get_counters(hififo_counters *c)
+{
+	if(ioctl(fd, _IO('f', IOC_COUNTERS), c) < 0)
+		throw std::runtime_error( "hififo get counters failed" );
+}
+
+void Hififo::clear_counters()
+{
+	if(ioctl(fd, _IO('f', IOC_COUNTERS_CLEAR), 0) != 0)
+		throw std::runtime_error( "hififo clear counters failed" );
+}
+
+size_t Hififo::word_bytes()
+{
+	return word;
+}
+
+int Hififo::channels()
+{
+	return nch;
+}
+
+int Hififo::numa_node()
+{
+	return node;
+}
+
+/* restrict the calling thread to the CPUs of the card's NUMA node */
+void Hififo::pin_thread()
+{
+	static thread_local int pinned_node = -1;
+	if((node < 0) || (pinned_node == node))
+		return;
+	char path[64];
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/node/node%d/cpulist", node);
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL)
+		return;
+	// cpulist is of the form 0-7,16-23
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	int first, last, sep;
+	while(fscanf(fp, "%d", &first) == 1){
+		last = first;
+		sep = fgetc(fp);
+		if((sep == '-') && (fscanf(fp, "%d", &last) == 1))
+			sep = fgetc(fp);
+		for(int cpu=first; (cpu<=last) && (cpu<CPU_SETSIZE); cpu++)
+			CPU_SET(cpu, &cpus);
+		if(sep != ',')
+			break;
+	}
+	fclose(fp);
+	if(sched_setaffinity(0, sizeof(cpus), &cpus) == 0)
+		pinned_node = node;
+}
+
+Hififo::Hififo(const char * filename, bool numa_local)
 {
 	fd = open(filename, O_RDWR);
 	if(fd < 0){
@@ -56,18 +162,126 @@ Hififo::Hififo(const char * filename)
 		cerr << "fifo_open(" << filename << ") failed\n";
 		throw std::runtime_error( "hififo open failed" );
 	}
+	this->numa_local = numa_local;
+	stage = NULL;
+	stage_size = 0;
+	pipefd[0] = pipefd[1] = -1;
+	pipe_size = 0;
+	// bits 7:0 fifo number, bit 8 to PC, bits 15:12 log2 word bytes,
+	// bits 23:16 NUMA node + 1, bits 29:24 channels each way
+	long info = ioctl(fd, _IO('f', IOC_INFO), 0);
+	if(info < 0){
+		const char *n = strrchr(filename, '_');
+		info = (n != NULL) && (atoi(n+1) >= 4) ? 1<<8 : 0;
+	}
+	to_pc = (info >> 8) & 1;
+	node = ((info >> 16) & 0xFF) - 1;
+	nch = (info >> 24) & 0x3F;
+	// older drivers report 0, 8 byte words
+	word = ((info >> 12) & 0xF) ? 1 << ((info >> 12) & 0xF) : 8;
 	set_timeout(1.0);
 }
 
+Hififo::Hififo(bool to_pc)
+{
+	fd = -1;
+	node = -1;
+	this->to_pc = to_pc;
+	numa_local = false;
+	word = 8;
+	nch = 0;
+	stage = NULL;
+	stage_size = 0;
+	pipefd[0] = pipefd[1] = -1;
+	pipe_size = 0;
+}
+
 Hififo::~Hififo()
 {
 	cerr << "closing hififo\n";
-	close(fd);
+	if(stage != NULL)
+		munmap(stage, stage_size);
+	if(pipefd[0] >= 0){
+		close(pipefd[0]);
+		close(pipefd[1]);
+	}
+	if(fd >= 0)
+		close(fd);
+}
+
+ssize_t Hififo::dev_read(void *buf, size_t count)
+{
+	return read(fd, (char *) buf, count);
+}
+
+ssize_t Hififo::dev_write(const void *buf, size_t count)
+{
+	return write(fd, buf, count);
+}
+
+/* grow the staging buffer, first touched from a thread on the card's node */
+void Hififo::stage_alloc(size_t count)
+{
+	if(count <= stage_size)
+		return;
+	if(stage != NULL)
+		munmap(stage, stage_size);
+	stage_size = 0;
+	stage = (char *) mmap(NULL, count, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(stage == MAP_FAILED){
+		stage = NULL;
+		throw std::runtime_error( "hififo staging buffer alloc failed" );
+	}
+	stage_size = count;
+	if(numa_local)
+		pin_thread();
+	memset(stage, 0, stage_size);
+}
+
+/*
+ * To PC: read count bytes into the staging buffer and return it, NULL on
+ * timeout. From PC: return a staging buffer to be filled and passed to
+ * put_buffer.
+ */
+void * Hififo::get_buffer(size_t count)
+{
+	if(numa_local)
+		pin_thread();
+	stage_alloc(count);
+	if(!to_pc)
+		return stage;
+	ssize_t rc;
+	{
+		TRACE_SCOPE("hififo read");
+		rc = dev_read(stage, count);
+	}
+	if((rc < 0) && (errno == ETIMEDOUT))
+		return NULL;
+	if(rc < 0)
+		throw std::runtime_error( "hififo read failed" );
+	if((size_t) rc != count)
+		return NULL;
+	return stage;
+}
+
+void Hififo::put_buffer(size_t count)
+{
+	if(!to_pc)
+		bwrite(stage, count);
 }
 
 ssize_t Hififo::bwrite(const char *buf, size_t count)
 {
-	ssize_t rc = write(fd, buf, count);
+	if(numa_local)
+		pin_thread();
+	ssize_t rc;
+	{
+		TRACE_SCOPE("hififo write");
+		rc = dev_write(buf, count);
+	}
+	if((rc < 0) && (errno == ETIMEDOUT))
+		throw hififo_timeout( "hififo write timeout" );
 	if((size_t) rc != count)
 		throw std::runtime_error( "hififo write failed" );
 	return rc;
@@ -75,10 +289,101 @@ ssize_t Hififo::bwrite(const char *buf, size_t count)
 
 ssize_t Hififo::bread(void * buf, size_t count)
 {
-	ssize_t rc = read(fd, (char *) buf, count);
+	if(numa_local)
+		pin_thread();
+	ssize_t rc;
+	{
+		TRACE_SCOPE("hififo read");
+		rc = dev_read(buf, count);
+	}
+	if((rc < 0) && (errno == ETIMEDOUT))
+		throw hififo_timeout( "hififo read timeout" );
 	if((size_t) rc != count) {
 		std::cerr << "rc = " << rc << std::endl;
 		throw std::runtime_error( "hififo read failed" );
 	}
 	return rc;
 }
+
+void Hififo::pipe_open()
+{
+	if(fd < 0)
+		throw std::runtime_error( "hififo splice not supported" );
+	if(pipefd[0] >= 0)
+		return;
+	if(pipe(pipefd) != 0)
+		throw std::runtime_error( "hififo pipe failed" );
+	// larger pipes take fewer splices, the default is 64 KB
+	fcntl(pipefd[1], F_SETPIPE_SZ, 1<<20);
+	int rc = fcntl(pipefd[1], F_GETPIPE_SZ);
+	pipe_size = rc > 0 ? rc : 65536;
+}
+
+/*
+ * The driver copies the ring to the pipe's pages and the kernel passes
+ * them on to out_fd, the data never passes through user memory.
+ */
+size_t Hififo::splice_to(int out_fd, size_t count)
+{
+	if(!to_pc || ((count & (word - 1)) != 0))
+		throw std::runtime_error( "hififo splice_to invalid" );
+	if(numa_local)
+		pin_thread();
+	pipe_open();
+	size_t done = 0;
+	while(done < count){
+		ssize_t rc;
+		{
+			TRACE_SCOPE("hififo splice");
+			rc = splice(fd, NULL, pipefd[1], NULL,
+				    min(count - done, pipe_size), SPLICE_F_MOVE);
+		}
+		if((rc < 0) && (errno == ETIMEDOUT))
+			throw hififo_timeout( "hififo splice timeout" );
+		if(rc <= 0)
+			throw std::runtime_error( "hififo splice failed" );
+		for(ssize_t n = rc; n > 0; n -= rc){
+			rc = splice(pipefd[0], NULL, out_fd, NULL, n, SPLICE_F_MOVE);
+			if(rc <= 0)
+				throw std::runtime_error( "hififo splice out failed" );
+			done += rc;
+		}
+	}
+	return done;
+}
+
+/* the FIFO takes whole words, a partial word waits in the pipe */
+size_t Hififo::splice_from(int in_fd, size_t count)
+{
+	if(to_pc || ((count & (word - 1)) != 0))
+		throw std::runtime_error( "hififo splice_from invalid" );
+	if(numa_local)
+		pin_thread();
+	pipe_open();
+	size_t done = 0, in_pipe = 0;
+	while(done < count){
+		size_t want = min(count - done, pipe_size) - in_pipe;
+		ssize_t rc;
+		if(want > 0){
+			rc = splice(in_fd, NULL, pipefd[1], NULL, want,
+				    SPLICE_F_MOVE);
+			if(rc <= 0)
+				throw std::runtime_error( "hififo splice in failed" );
+			in_pipe += rc;
+		}
+		size_t n = in_pipe & ~(word - 1);
+		if(n == 0)
+			continue;
+		{
+			TRACE_SCOPE("hififo splice");
+			rc = splice(pipefd[0], NULL, fd, NULL, n, SPLICE_F_MOVE);
+		}
+		if((rc < 0) && (errno == ETIMEDOUT))
+			throw hififo_timeout( "hififo splice timeout" );
+		if(rc <= 0)
+			throw std::runtime_error( "hififo splice failed" );
+		in_pipe -= rc;
+		done += rc;
+	}
+	return done;
+}
@@ -18,15 +18,85 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdexcept>
+
+/* thrown by bread / bwrite when the driver times out */
+class hififo_timeout : public std::runtime_error {
+public:
+	hififo_timeout(const char * what) : std::runtime_error(what) {}
+};
+
+/*
+ * Free running hardware performance counters, 32 bits, wrapping.
+ * Counts are clock cycles unless noted. Layout matches BAR0 qwords
+ * 16 to 63, see hififo.v.
+ */
+struct hififo_counters {
+	uint32_t cycles;
+	uint32_t tx_busy; // a word was accepted by the PCIe core
+	uint32_t tx_stall; // the core held off a word
+	uint32_t tx_completions; // TLPs
+	uint32_t tx_read_requests; // TLPs
+	uint32_t tx_writes; // TLPs
+	uint32_t rx_busy;
+	uint32_t rx_tlps; // TLPs
+	struct {
+		uint32_t requests; // read request TLPs
+		uint32_t tag_stall; // all tags outstanding
+		uint32_t full_stall; // user FIFO full
+		uint32_t latency_sum; // request to last completion
+		uint32_t latency_max;
+		uint32_t occupancy; // max << 16 | min, FIFO words in flight
+	} fpc[4];
+	struct {
+		uint32_t words; // FIFO words sent
+		uint32_t grant_stall; // waiting for the TX arbiter
+		uint32_t empty; // user FIFO empty, room in the host ring
+		uint32_t host_stall; // host ring full
+	} tpc[4];
+};
+
 class Hififo {
 private:
 	int fd;
+	int node; // NUMA node of the card, -1 if unknown
+	bool to_pc;
+	bool numa_local;
+	char * stage; // staging buffer for get_buffer / put_buffer
+	size_t stage_size;
+	void stage_alloc(size_t count);
+	int pipefd[2]; // for splice_to / splice_from
+	size_t pipe_size;
+	void pipe_open();
 protected:
+	size_t word; // FIFO word bytes, transfers are a multiple of this
+	int nch; // channels each way, 0 if the driver does not report it
+	// for transports other than the driver, such as a simulation
+	Hififo(bool to_pc);
+	// read(2) / write(2) semantics, -1 and errno = ETIMEDOUT on timeout
+	virtual ssize_t dev_read(void *buf, size_t count);
+	virtual ssize_t dev_write(const void *buf, size_t count);
 public:
-	Hififo(const char * filename);
-	~Hififo();
+	Hififo(const char * filename, bool numa_local = false);
+	virtual ~Hififo();
 	ssize_t bwrite(const char *buf, size_t count);
 	ssize_t bread(void * buf, size_t count);
-	void set_timeout(double timeout);
-	char * get_fpga_build_time();
+	// move count bytes between the FIFO and a file or socket via a pipe
+	size_t splice_to(int out_fd, size_t count);
+	size_t splice_from(int in_fd, size_t count);
+	void * get_buffer(size_t count);
+	void put_buffer(size_t count);
+	virtual void set_timeout(double timeout);
+	virtual void set_moderation(double latency);
+	virtual size_t flush();
+	// to PC frames of words FIFO words, 0 for none, see Frame.h. Flushes.
+	virtual void set_framing(size_t words);
+	virtual char * get_fpga_build_time();
+	virtual void get_counters(hififo_counters *c);
+	virtual void clear_counters();
+	int numa_node();
+	void pin_thread();
+	size_t word_bytes();
+	int channels();
 };
@@ -0,0 +1,143 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "HififoGroup.h"
+
+using namespace std;
+
+HififoGroup::HififoGroup(int fifo, int ncards, size_t block_size)
+{
+	if((ncards < 1) || (block_size == 0))
+		throw std::runtime_error( "hififo group: bad arguments" );
+	this->block_size = block_size;
+	sequence = 0;
+	job_id = 0;
+	pending = 0;
+	failed = false;
+	quit = false;
+	char filename[32];
+	fifos.reserve(ncards);
+	try{
+		for(int i=0; i<ncards; i++){
+			snprintf(filename, sizeof(filename), "/dev/hififo_%d_%d", i, fifo);
+			// workers are pinned to the node of their own card
+			fifos.push_back(new Hififo {filename, true});
+		}
+	}
+	catch(...){
+		// no destructor runs, close the cards already open
+		for(auto f : fifos)
+			delete f;
+		throw;
+	}
+	for(int i=0; i<ncards; i++)
+		workers.push_back(std::thread(&HififoGroup::worker, this, i));
+}
+
+HififoGroup::~HififoGroup()
+{
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		quit = true;
+	}
+	cv_start.notify_all();
+	for(auto & w : workers)
+		w.join();
+	for(auto f : fifos)
+		delete f;
+}
+
+void HififoGroup::worker(size_t card)
+{
+	size_t n = fifos.size();
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lk(lock);
+	while(true){
+		cv_start.wait(lk, [&]{ return quit || (job_id != seen); });
+		if(quit)
+			return;
+		seen = job_id;
+		char *buf = job_buf;
+		size_t nblocks = job_blocks;
+		bool write = job_write;
+		// index in this job of the first block belonging to this card
+		size_t i = (card + n - job_first % n) % n;
+		lk.unlock();
+		bool ok = true;
+		try{
+			for(; i<nblocks; i+=n){
+				if(write)
+					fifos[card]->bwrite(buf + i*block_size, block_size);
+				else
+					fifos[card]->bread(buf + i*block_size, block_size);
+			}
+		}
+		catch(const std::runtime_error & e){
+			cerr << "hififo group card " << card << ": " << e.what() << "\n";
+			ok = false;
+		}
+		lk.lock();
+		failed |= !ok;
+		if(--pending == 0)
+			cv_done.notify_all();
+	}
+}
+
+void HififoGroup::run(char * buf, size_t count, bool write)
+{
+	if((count % block_size) != 0)
+		throw std::runtime_error( "hififo group: count not a multiple of block size" );
+	std::unique_lock<std::mutex> lk(lock);
+	if(failed)
+		throw std::runtime_error( "hififo group stopped by an earlier failure" );
+	job_buf = buf;
+	job_first = sequence;
+	job_blocks = count / block_size;
+	job_write = write;
+	pending = fifos.size();
+	job_id++;
+	cv_start.notify_all();
+	cv_done.wait(lk, [&]{ return pending == 0; });
+	sequence += job_blocks;
+	if(failed)
+		throw std::runtime_error( write ? "hififo group write failed" :
+					  "hififo group read failed" );
+}
+
+ssize_t HififoGroup::bwrite(const char *buf, size_t count)
+{
+	run((char *) buf, count, true);
+	return count;
+}
+
+ssize_t HififoGroup::bread(void * buf, size_t count)
+{
+	run((char *) buf, count, false);
+	return count;
+}
+
+void HififoGroup::set_timeout(double timeout)
+{
+	for(auto f : fifos)
+		f->set_timeout(timeout);
+}
@@ -0,0 +1,63 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include "Hififo.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * Stripes one stream across the same FIFO on several cards. Block n of
+ * the stream goes to card n % ncards, so the block sequence number
+ * selects both the card and the position in the caller's buffer. Each
+ * card has its own worker thread which transfers directly to or from
+ * the caller's buffer.
+ *
+ * A card failing or timing out leaves the cards out of step, so the
+ * group stops: that transfer and every later one throws. Recover by
+ * destroying the group and opening a new one.
+ */
+class HififoGroup {
+private:
+	std::vector<Hififo *> fifos;
+	std::vector<std::thread> workers;
+	size_t block_size;
+	uint64_t sequence; // sequence number of the next block in the stream
+	// current job, protected by lock
+	std::mutex lock;
+	std::condition_variable cv_start, cv_done;
+	uint64_t job_id;
+	char * job_buf;
+	uint64_t job_first;
+	size_t job_blocks;
+	bool job_write;
+	size_t pending;
+	bool failed; // sticky, a card failed and the stripes are out of step
+	bool quit;
+	void worker(size_t card);
+	void run(char * buf, size_t count, bool write);
+public:
+	HififoGroup(int fifo, int ncards, size_t block_size);
+	~HififoGroup();
+	ssize_t bwrite(const char *buf, size_t count);
+	ssize_t bread(void * buf, size_t count);
+	void set_timeout(double timeout);
+};
@@ -0,0 +1,111 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdint.h>
+#include <iostream>
+
+#include "Histogram.h"
+
+using namespace std;
+
+#define NBUCKETS ((64 - SUB_BITS + 1) << SUB_BITS)
+
+Histogram::Histogram() : counts(NBUCKETS, 0)
+{
+	clear();
+}
+
+size_t Histogram::index(uint64_t v)
+{
+	if(v < (1 << SUB_BITS))
+		return v;
+	int e = 63 - __builtin_clzll(v);
+	size_t sub = (v >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+	return ((e - SUB_BITS + 1) << SUB_BITS) | sub;
+}
+
+// highest value which maps to bucket i
+uint64_t Histogram::value(size_t i)
+{
+	size_t b = i >> SUB_BITS;
+	uint64_t sub = i & ((1 << SUB_BITS) - 1);
+	if(b == 0)
+		return sub;
+	uint64_t lower = ((1L << SUB_BITS) + sub) << (b - 1);
+	return lower + (1L << (b - 1)) - 1;
+}
+
+void Histogram::record(uint64_t v)
+{
+	counts[index(v)]++;
+	if(v < min_v)
+		min_v = v;
+	if(v > max_v)
+		max_v = v;
+	sum += v;
+	n++;
+}
+
+void Histogram::merge(const Histogram & h)
+{
+	for(size_t i=0; i<counts.size(); i++)
+		counts[i] += h.counts[i];
+	if(h.n && (h.min_v < min_v))
+		min_v = h.min_v;
+	if(h.max_v > max_v)
+		max_v = h.max_v;
+	sum += h.sum;
+	n += h.n;
+}
+
+void Histogram::clear()
+{
+	for(auto & c : counts)
+		c = 0;
+	n = 0;
+	min_v = UINT64_MAX;
+	max_v = 0;
+	sum = 0;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+	if(n == 0)
+		return 0;
+	uint64_t target = (uint64_t) (p * 0.01 * n + 0.5);
+	if(target < 1)
+		target = 1;
+	uint64_t seen = 0;
+	for(size_t i=0; i<counts.size(); i++){
+		seen += counts[i];
+		if(seen >= target)
+			return value(i) < max_v ? value(i) : max_v;
+	}
+	return max_v;
+}
+
+void Histogram::report(const char *name, const char *units) const
+{
+	cerr << name << ": " << n << " samples, " << units
+	     << " min " << min()
+	     << " mean " << (uint64_t) mean()
+	     << " p50 " << percentile(50)
+	     << " p99 " << percentile(99)
+	     << " p99.9 " << percentile(99.9)
+	     << " max " << max() << "\n";
+}
@@ -0,0 +1,52 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Log-linear histogram in the style of HdrHistogram. Each power of two
+ * is split into 2**SUB_BITS linear sub-buckets, so any recorded value is
+ * reported within 1/32 of its true value over the full 64 bit range.
+ */
+
+class Histogram {
+private:
+	static const int SUB_BITS = 5;
+	std::vector<uint64_t> counts;
+	uint64_t n;
+	uint64_t min_v;
+	uint64_t max_v;
+	double sum;
+	static size_t index(uint64_t v);
+	static uint64_t value(size_t i);
+public:
+	Histogram();
+	void record(uint64_t v);
+	void merge(const Histogram & h);
+	void clear();
+	uint64_t percentile(double p) const; // p in percent
+	uint64_t count() const { return n; }
+	uint64_t min() const { return n ? min_v : 0; }
+	uint64_t max() const { return max_v; }
+	double mean() const { return n ? sum / n : 0; }
+	void report(const char *name, const char *units = "ns") const;
+};
@@ -0,0 +1,204 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+
+#include "Pattern.h"
+#include "Trace.h"
+
+using namespace std;
+
+// runtime dispatch to the widest vector unit available
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define PATTERN_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define PATTERN_CLONES
+#endif
+
+#define BLOCK 256 // words checked between looks at the error flags
+
+static inline uint64_t lfsr_next(uint64_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return x;
+}
+
+// bits of cur which do not follow from the 31 bits before them
+static inline uint64_t prbs31_error(uint64_t prev, uint64_t cur)
+{
+	return cur ^ ((cur << 31) | (prev >> 33)) ^ ((cur << 28) | (prev >> 36));
+}
+
+static inline uint64_t prbs31_next(uint64_t prev)
+{
+	// each pass fixes 28 more bits
+	uint64_t w = 0;
+	for(int i=0; i<3; i++)
+		w = ((w << 31) | (prev >> 33)) ^ ((w << 28) | (prev >> 36));
+	return w;
+}
+
+/*
+ * e[j] = p[j] XOR (prediction from p[j-1]), p[-1] must be valid.
+ * Returns the OR of all of e so the caller only looks at e on error.
+ */
+#define CHECK_KERNEL(name, expr)					\
+	PATTERN_CLONES static uint64_t name(const uint64_t *p,		\
+					    uint64_t *e, size_t n)	\
+	{								\
+		uint64_t any = 0;					\
+		for(size_t j=0; j<n; j++){				\
+			uint64_t prev = p[j-1];				\
+			uint64_t cur = p[j];				\
+			e[j] = (expr);					\
+			any |= e[j];					\
+		}							\
+		return any;						\
+	}
+
+CHECK_KERNEL(check_counter, cur ^ (prev + 1))
+CHECK_KERNEL(check_lfsr, cur ^ lfsr_next(prev))
+CHECK_KERNEL(check_prbs31, prbs31_error(prev, cur))
+
+PATTERN_CLONES static void generate_counter(uint64_t *buf, size_t count,
+					    uint64_t start)
+{
+	for(size_t j=0; j<count; j++)
+		buf[j] = start + j;
+}
+
+Pattern::Pattern(pattern_type type, uint64_t seed)
+{
+	this->type = type;
+	// the LFSR and PRBS lock up on all zeros
+	if((type != PATTERN_COUNTER) && ((seed >> 33) == 0))
+		seed = ~seed;
+	state = seed;
+	seeded = false;
+	clear();
+}
+
+void Pattern::clear()
+{
+	memset(&errors, 0, sizeof(errors));
+	errors.first_error = -1;
+}
+
+void Pattern::generate(uint64_t *buf, size_t count)
+{
+	if(count == 0)
+		return;
+	TRACE_SCOPE("pattern generate");
+	size_t j = 0;
+	if(!seeded){
+		buf[j++] = state;
+		seeded = true;
+	}
+	switch(type){
+	case PATTERN_COUNTER:
+		generate_counter(&buf[j], count - j, state + 1);
+		break;
+	case PATTERN_LFSR:
+		for(uint64_t x = state; j<count; j++)
+			buf[j] = x = lfsr_next(x);
+		break;
+	case PATTERN_PRBS31:
+		for(uint64_t x = state; j<count; j++)
+			buf[j] = x = prbs31_next(x);
+		break;
+	}
+	state = buf[count-1];
+}
+
+// slow path, only called for blocks containing an error
+void Pattern::count_errors(const uint64_t *e, size_t n, uint64_t offset)
+{
+	for(size_t j=0; j<n; j++){
+		uint64_t bits = e[j];
+		if(bits == 0)
+			continue;
+		if(errors.first_error < 0)
+			errors.first_error = offset + j;
+		errors.word_errors++;
+		errors.bit_errors += __builtin_popcountll(bits);
+		while(bits){
+			errors.bit_position[__builtin_ctzll(bits)]++;
+			bits &= bits - 1;
+		}
+	}
+}
+
+void Pattern::check(const uint64_t *buf, size_t count)
+{
+	if(count == 0)
+		return;
+	TRACE_SCOPE("pattern check");
+	uint64_t e[BLOCK];
+	size_t j = 0;
+	if(!seeded){
+		j = 1; // the first word of the stream is the seed
+		seeded = true;
+	}
+	else{
+		uint64_t p[2] = {state, buf[0]};
+		uint64_t any = 0;
+		switch(type){
+		case PATTERN_COUNTER: any = check_counter(&p[1], e, 1); break;
+		case PATTERN_LFSR: any = check_lfsr(&p[1], e, 1); break;
+		case PATTERN_PRBS31: any = check_prbs31(&p[1], e, 1); break;
+		}
+		if(any)
+			count_errors(e, 1, errors.words);
+		j = 1;
+	}
+	while(j < count){
+		size_t n = count - j < BLOCK ? count - j : BLOCK;
+		uint64_t any = 0;
+		switch(type){
+		case PATTERN_COUNTER: any = check_counter(&buf[j], e, n); break;
+		case PATTERN_LFSR: any = check_lfsr(&buf[j], e, n); break;
+		case PATTERN_PRBS31: any = check_prbs31(&buf[j], e, n); break;
+		}
+		if(any)
+			count_errors(e, n, errors.words + j);
+		j += n;
+	}
+	errors.words += count;
+	state = buf[count-1];
+}
+
+void Pattern::report(const char *name)
+{
+	cerr << name << ": " << errors.words << " words, "
+	     << errors.word_errors << " word errors, "
+	     << errors.bit_errors << " bit errors";
+	if(errors.first_error >= 0)
+		cerr << ", first at word " << errors.first_error;
+	cerr << "\n";
+	if(errors.bit_errors == 0)
+		return;
+	for(int i=0; i<64; i++)
+		if(errors.bit_position[i] != 0)
+			cerr << "  bit " << i << ": "
+			     << errors.bit_position[i] << "\n";
+}
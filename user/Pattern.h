@@ -0,0 +1,63 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Test pattern generators and checkers for link validation.
+ *
+ * COUNTER: each word is the previous word + 1
+ * LFSR:    each word is xorshift64 of the previous word
+ * PRBS31:  the words are a PRBS31 (x^31 + x^28 + 1) bit stream, LSB first
+ *
+ * The checkers are self synchronizing: each word is predicted from the
+ * previous one, so a dropped or corrupted word is counted without losing
+ * lock. The first word of a stream is taken as the seed.
+ */
+
+enum pattern_type {
+	PATTERN_COUNTER = 0,
+	PATTERN_LFSR = 1,
+	PATTERN_PRBS31 = 2
+};
+
+struct pattern_errors {
+	uint64_t words; // words checked
+	uint64_t word_errors; // words not matching the prediction
+	uint64_t bit_errors; // total bits in error
+	int64_t first_error; // word offset of the first error, -1 if none
+	uint64_t bit_position[64]; // errors seen on each bit of the word
+};
+
+class Pattern {
+private:
+	pattern_type type;
+	uint64_t state; // last word generated or checked
+	bool seeded;
+	void count_errors(const uint64_t *e, size_t n, uint64_t offset);
+public:
+	pattern_errors errors;
+	Pattern(pattern_type type, uint64_t seed = 0);
+	void generate(uint64_t *buf, size_t count);
+	void check(const uint64_t *buf, size_t count);
+	void clear();
+	void report(const char *name);
+};
@@ -0,0 +1,161 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "Playback.h"
+
+using namespace std;
+
+Playback::Playback(Hififo * fifo, const char * filename, size_t chunk)
+{
+	this->fifo = fifo;
+	wsize = fifo->word_bytes();
+	this->chunk = chunk & ~(size_t) (wsize-1);
+	if(this->chunk == 0)
+		throw std::runtime_error( "playback chunk too small" );
+	fd = open(filename, O_RDONLY);
+	if(fd < 0){
+		perror(filename);
+		throw std::runtime_error( "playback open failed" );
+	}
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size == 0)){
+		close(fd);
+		throw std::runtime_error( "playback: empty file" );
+	}
+	size = st.st_size;
+	map = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED){
+		close(fd);
+		throw std::runtime_error( "playback mmap failed" );
+	}
+	advise(map, size, MADV_SEQUENTIAL);
+	if(posix_memalign((void **) &bounce, wsize, wsize) != 0)
+		throw std::runtime_error( "playback alloc failed" );
+	bytes_written = 0;
+	stopping = false;
+}
+
+Playback::~Playback()
+{
+	free(bounce);
+	munmap(map, size);
+	close(fd);
+}
+
+size_t Playback::file_size()
+{
+	return size;
+}
+
+void Playback::stop()
+{
+	stopping = true;
+}
+
+/* madvise wants page aligned ranges */
+void Playback::advise(const char * p, size_t len, int advice)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t first = ((uintptr_t) p) & ~(page-1);
+	uintptr_t last = (uintptr_t) p + len;
+	if(last > (uintptr_t) map + size)
+		last = (uintptr_t) map + size;
+	if(last > first)
+		madvise((void *) first, last - first, advice);
+}
+
+/*
+ * Write total bytes (0 = until stop()) of the segment [start,
+ * start+length) repeated back to back. drop releases the page cache
+ * behind the write point for segments played only once.
+ */
+void Playback::feed(uint64_t start, uint64_t length, uint64_t total, bool drop)
+{
+	if((start >= size) || (length == 0) || (start + length > size))
+		throw std::runtime_error( "playback: segment outside of file" );
+	const char *seg = map + start;
+	uint64_t o = 0; // offset in segment
+	uint64_t emitted = 0;
+	stopping = false;
+	while(!stopping && ((total == 0) || (emitted < total))){
+		uint64_t n = length - o;
+		if(n > chunk)
+			n = chunk;
+		if((total != 0) && (n > total - emitted))
+			n = total - emitted;
+		n &= ~(uint64_t) (wsize-1);
+		if(n == 0){
+			// less than a write left before the wrap or the end
+			size_t k = 0;
+			while((k < wsize) && ((total == 0) || (emitted + k < total))){
+				size_t m = wsize - k;
+				if(m > length - o)
+					m = length - o;
+				if((total != 0) && (m > total - emitted - k))
+					m = total - emitted - k;
+				memcpy(bounce + k, seg + o, m);
+				k += m;
+				o += m;
+				if(o == length)
+					o = 0;
+			}
+			memset(bounce + k, 0, wsize - k);
+			fifo->bwrite(bounce, wsize);
+			emitted += k;
+			bytes_written += wsize;
+			continue;
+		}
+		// read ahead of the next chunk while this one is written
+		uint64_t next = (o + n == length) ? 0 : o + n;
+		advise(seg + next, chunk, MADV_WILLNEED);
+		fifo->bwrite(seg + o, n);
+		if(drop){
+			advise(seg + o, n, MADV_DONTNEED);
+			posix_fadvise(fd, start + o, n, POSIX_FADV_DONTNEED);
+		}
+		o = next;
+		emitted += n;
+		bytes_written += n;
+	}
+}
+
+/* play [start, start+length) once, length 0 is to the end of the file */
+void Playback::play(uint64_t start, uint64_t length)
+{
+	if(length == 0)
+		length = size - start;
+	feed(start, length, length, true);
+}
+
+/* play [start, start+length) count times without gaps, count 0 is forever */
+void Playback::loop(uint64_t start, uint64_t length, uint64_t count)
+{
+	if(length == 0)
+		length = size - start;
+	feed(start, length, count * length, false);
+}
@@ -0,0 +1,52 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include "Hififo.h"
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Plays a file to a from PC FIFO straight out of a memory mapping, so
+ * playback starts at once and memory use does not grow with the file.
+ * Lengths need not be a multiple of the FIFO word size: a segment
+ * being looped wraps inside a small bounce buffer so the stream has no
+ * gap at the wrap point, and the end of the stream is zero padded.
+ */
+class Playback {
+private:
+	Hififo * fifo;
+	int fd;
+	char * map;
+	size_t size;
+	size_t chunk;
+	size_t wsize; // FIFO word bytes, the write granularity
+	char * bounce;
+	std::atomic<bool> stopping;
+	void advise(const char * p, size_t len, int advice);
+	void feed(uint64_t start, uint64_t length, uint64_t total, bool drop);
+public:
+	uint64_t bytes_written;
+	Playback(Hififo * fifo, const char * filename, size_t chunk = 4<<20);
+	~Playback();
+	void play(uint64_t start = 0, uint64_t length = 0);
+	void loop(uint64_t start, uint64_t length, uint64_t count = 0);
+	void stop();
+	size_t file_size();
+};
@@ -0,0 +1,150 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "TimeIt.h"
+#include "Recorder.h"
+#include "Trace.h"
+
+using namespace std;
+
+Recorder::Recorder(Hififo * fifo, const char * filename, size_t block_size,
+		   size_t nbuffers, int nwriters)
+{
+	if((block_size == 0) || ((block_size & 4095) != 0))
+		throw std::runtime_error( "recorder block size must be a multiple of 4096" );
+	this->fifo = fifo;
+	this->block_size = block_size;
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if((fd < 0) && (errno == EINVAL)) // filesystem without O_DIRECT
+		fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0){
+		perror(filename);
+		throw std::runtime_error( "recorder open failed" );
+	}
+	for(size_t i=0; i<nbuffers; i++){
+		void *p;
+		if(posix_memalign(&p, 4096, block_size) != 0)
+			throw std::runtime_error( "recorder buffer alloc failed" );
+		buffers.push_back((char *) p);
+		free_q.push_back(i);
+	}
+	memset(&stats, 0, sizeof(stats));
+	done = false;
+	failed = false;
+	stopping = false;
+	for(int i=0; i<nwriters; i++)
+		writers.push_back(std::thread(&Recorder::writer, this));
+}
+
+Recorder::~Recorder()
+{
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		done = true;
+	}
+	cv_full.notify_all();
+	for(auto & w : writers)
+		w.join();
+	for(auto b : buffers)
+		free(b);
+	close(fd);
+}
+
+void Recorder::writer()
+{
+	std::unique_lock<std::mutex> lk(lock);
+	while(true){
+		cv_full.wait(lk, [&]{ return done || !full_q.empty(); });
+		if(full_q.empty())
+			return;
+		auto job = full_q.front();
+		full_q.pop_front();
+		lk.unlock();
+		ssize_t rc;
+		{
+			TRACE_SCOPE("recorder pwrite");
+			rc = pwrite(fd, buffers[job.first], block_size, job.second);
+		}
+		lk.lock();
+		TRACE_COUNTER("recorder queued", full_q.size());
+		if((size_t) rc != block_size){
+			perror("recorder write");
+			failed = true;
+		}
+		else{
+			stats.bytes += block_size;
+			stats.blocks++;
+		}
+		free_q.push_back(job.first);
+		cv_free.notify_one();
+	}
+}
+
+void Recorder::stop()
+{
+	stopping = true;
+}
+
+/* record bytes from the FIFO, 0 to record until stop() or a timeout */
+void Recorder::run(uint64_t bytes)
+{
+	TimeIt timer{};
+	uint64_t offset = 0;
+	std::unique_lock<std::mutex> lk(lock);
+	while(!stopping && !failed && ((bytes == 0) || (offset < bytes))){
+		if(free_q.empty()){
+			stats.stalls++;
+			TimeIt stall{};
+			cv_free.wait(lk, [&]{ return !free_q.empty(); });
+			stats.stall_time += stall.elapsed();
+		}
+		size_t b = free_q.front();
+		free_q.pop_front();
+		lk.unlock();
+		try{
+			fifo->bread(buffers[b], block_size);
+		}
+		catch(const std::runtime_error & e){
+			cerr << "recorder: " << e.what() << "\n";
+			lk.lock();
+			free_q.push_back(b);
+			break;
+		}
+		lk.lock();
+		full_q.push_back(std::make_pair(b, offset));
+		if(full_q.size() > stats.max_queued)
+			stats.max_queued = full_q.size();
+		cv_full.notify_one();
+		offset += block_size;
+	}
+	// wait for the writers to drain
+	cv_free.wait(lk, [&]{ return free_q.size() == buffers.size(); });
+	stats.elapsed = timer.elapsed();
+	if(failed)
+		throw std::runtime_error( "recorder write failed" );
+}
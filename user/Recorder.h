@@ -0,0 +1,68 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include "Hififo.h"
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+struct recorder_stats {
+	uint64_t bytes; // bytes written to storage
+	uint64_t blocks;
+	uint64_t stalls; // times the reader found no free buffer
+	double stall_time; // seconds the reader spent waiting on storage
+	size_t max_queued; // most blocks waiting to be written at once
+	double elapsed;
+};
+
+/*
+ * Records a to PC FIFO to a file. The reader thread reads into a pool of
+ * page aligned buffers which a set of writer threads write out with
+ * O_DIRECT, so reading and storage writes overlap and the data is
+ * copied only once, by the driver. Several writers keep several writes
+ * in flight for striped arrays.
+ */
+class Recorder {
+private:
+	Hififo * fifo;
+	int fd;
+	size_t block_size;
+	std::vector<char *> buffers;
+	std::vector<std::thread> writers;
+	std::mutex lock;
+	std::condition_variable cv_free, cv_full;
+	std::deque<size_t> free_q;
+	std::deque<std::pair<size_t, uint64_t>> full_q; // buffer, file offset
+	bool done;
+	bool failed;
+	std::atomic<bool> stopping;
+	void writer();
+public:
+	recorder_stats stats;
+	Recorder(Hififo * fifo, const char * filename, size_t block_size = 4<<20,
+		 size_t nbuffers = 16, int nwriters = 4);
+	~Recorder();
+	void run(uint64_t bytes);
+	void stop();
+};
@@ -26,18 +26,50 @@
 #include <vector>
 
 #include "Sequencer.h"
+#include "Trace.h"
 
 using namespace std;
 
+// extended instructions
+#define SEQ_EXT(op) ((uint64_t) (op) << 56)
+#define SEQ_LOAD 1
+#define SEQ_RUN 2
+#define SEQ_LOOP 3
+#define SEQ_HALT 4
+#define SEQ_TIMESTAMP 5
+#define SEQ_PMEM_WORDS 256 // sequencer.v PBITS = 8
+
 Sequencer::Sequencer(const char * filename_write, const char * filename_read)
 {
 	wf = new Hififo {filename_write};
 	rf = new Hififo {filename_read};
+	owned = true;
+	init();
+}
+
+Sequencer::Sequencer(Hififo *write, Hififo *read)
+{
+	wf = write;
+	rf = read;
+	owned = false;
+	init();
+}
+
+void Sequencer::init()
+{
 	reads_expected = 0;
+	program_start = 0;
+	recording = false;
+	wbufv.reserve(4096);
+	rbufv.reserve(4096);
+	bindings.reserve(256);
+	results.reserve(256);
 }
 
 Sequencer::~Sequencer()
 {
+	if(!owned)
+		return;
 	delete wf;
 	delete rf;
 }
@@ -80,42 +112,163 @@ uint64_t Sequencer::read(uint32_t address)
 
 void Sequencer::read_multi(uint32_t address, void *data, uint64_t count)
 {
-	std::vector<uint64_t> rv = read_multi(address, count);
-	memcpy(data, &rv[0], count*8);
+	read_instr(count, address, false, data, 8);
+	run();
 }
 
 std::vector<uint64_t> Sequencer::read_multi(uint32_t address, uint64_t count)
 {
-	if(count != 0)
-		wbufv.push_back(3L<<62 | 0L<<61 | count << 32 | address);
-	reads_expected += count;
+	read_instr(count, address, false, NULL, 8);
 	run();
-	std::vector<uint64_t> rv(reads_expected);
-	if(reads_expected != 0)
-		rf->bread(&rv[0], 8*reads_expected);
-	reads_expected = 0;
+	std::vector<uint64_t> rv(results);
+	results.clear();
 	return rv;
 }
 
-void Sequencer::read_req(size_t count, uint32_t address)
+void Sequencer::read_instr(size_t count, uint32_t address, bool increment,
+			   void *dst, int width)
 {
-	append(3L<<62 | 1L<<61 | count << 32 | address);
+	if(count == 0)
+		return;
+	wbufv.push_back(3L<<62 | (uint64_t) increment<<61 | count << 32 | address);
+	bind(count, dst, width);
+}
+
+void Sequencer::bind(size_t count, void *dst, int width)
+{
+	// results of a program are collected with read_stream
+	if(recording)
+		return;
+	// merge with the previous binding when contiguous
+	if(!bindings.empty()){
+		read_binding & b = bindings.back();
+		if((b.width == width) &&
+		   (((b.dst == NULL) && (dst == NULL)) ||
+		    ((b.dst != NULL) && ((char *) b.dst + b.count * width == dst)))){
+			b.count += count;
+			reads_expected += count;
+			return;
+		}
+	}
+	bindings.push_back({dst, count, width});
 	reads_expected += count;
 }
 
-void Sequencer::run()
+void Sequencer::read_req(size_t count, uint32_t address)
+{
+	read_instr(count, address, true, NULL, 8);
+}
+
+void Sequencer::read_req(size_t count, uint32_t address, uint64_t *dst)
+{
+	read_instr(count, address, true, dst, 8);
+}
+
+void Sequencer::read_req(size_t count, uint32_t address, uint32_t *dst)
 {
-	// generate a flush for the read FIFO
-	size_t excess_reads = reads_expected % 16; // 128 bytes
-	if(excess_reads != 0)
-		read_req(16 - excess_reads, 0);
-	// generate a flush for the write FIFO
-	size_t excess_writes = wbufv.size() % 64; // 512 bytes
-	if(excess_writes != 0){
-		size_t fill_count = 64 - excess_writes;
-		while(fill_count--)
-			wbufv.push_back(0);
+	read_instr(count, address, true, dst, 4);
+}
+
+void Sequencer::read_req(size_t count, uint32_t address, char *dst)
+{
+	read_instr(count, address, true, dst, 1);
+}
+
+void Sequencer::scatter()
+{
+	const uint64_t *src = &rbufv[0];
+	for(auto & b : bindings){
+		if(b.dst == NULL)
+			results.insert(results.end(), src, src + b.count);
+		else if(b.width == 8)
+			memcpy(b.dst, src, 8 * b.count);
+		else if(b.width == 4)
+			for(size_t i=0; i<b.count; i++)
+				((uint32_t *) b.dst)[i] = src[i];
+		else
+			for(size_t i=0; i<b.count; i++)
+				((char *) b.dst)[i] = src[i];
+		src += b.count;
 	}
-	wf->bwrite((const char *) &wbufv[0], 8*wbufv.size());
+}
+
+void Sequencer::run()
+{
+	TRACE_SCOPE("sequencer run");
+	if(recording)
+		throw std::runtime_error( "sequencer: run while recording a program" );
+	// transfers are whole FIFO words, pad reads and instructions to fit
+	size_t word = wf->word_bytes() / 8;
+	if((reads_expected % word) != 0)
+		timestamp(&pad);
+	while((wbufv.size() % word) != 0)
+		wbufv.push_back(0); // NOP
+	if(wbufv.size() != 0)
+		wf->bwrite((const char *) &wbufv[0], 8*wbufv.size());
 	wbufv.clear();
+	if(reads_expected == 0)
+		return;
+	// a single 64 bit destination is read in place
+	read_binding & b = bindings[0];
+	if((bindings.size() == 1) && (b.width == 8) && (b.dst != NULL))
+		rf->bread(b.dst, 8*reads_expected);
+	else{
+		rbufv.resize(reads_expected);
+		rf->bread(&rbufv[0], 8*reads_expected);
+		scatter();
+	}
+	bindings.clear();
+	reads_expected = 0;
+}
+
+void Sequencer::program_begin()
+{
+	program_start = wbufv.size();
+	recording = true;
+}
+
+void Sequencer::program_end(uint32_t address)
+{
+	uint64_t count = wbufv.size() - program_start;
+	if(count + address > SEQ_PMEM_WORDS)
+		throw std::runtime_error( "sequencer: program exceeds program memory" );
+	wbufv.insert(wbufv.begin() + program_start,
+		     SEQ_EXT(SEQ_LOAD) | count << 32 | address);
+	recording = false;
+}
+
+void Sequencer::run_program(uint32_t address)
+{
+	wbufv.push_back(SEQ_EXT(SEQ_RUN) | address);
+}
+
+void Sequencer::loop(uint32_t address, uint16_t count)
+{
+	wbufv.push_back(SEQ_EXT(SEQ_LOOP) | (uint64_t) count << 32 | address);
+}
+
+void Sequencer::timestamp(uint64_t *dst)
+{
+	wbufv.push_back(SEQ_EXT(SEQ_TIMESTAMP) | 1L<<32);
+	bind(1, dst, 8);
+}
+
+/*
+ * in a program, the HALT instruction. Otherwise stops a running program
+ * now and discards the results it streamed: the from PC flush resets the
+ * sequencer, the to PC flush drops what is queued behind it.
+ */
+void Sequencer::halt()
+{
+	if(recording){
+		wbufv.push_back(SEQ_EXT(SEQ_HALT));
+		return;
+	}
+	wf->flush();
+	rf->flush();
+}
+
+void Sequencer::read_stream(uint64_t *dst, size_t count)
+{
+	rf->bread(dst, 8*count);
 }
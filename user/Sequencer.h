@@ -21,24 +21,73 @@
 #include "Hififo.h"
 #include <vector>
 
+/*
+ * Instructions are encoded into a buffer reserved up front. Each read
+ * request is bound to a destination which the read data is scattered to
+ * when run() completes, so steady state traffic does not allocate.
+ * Reads without a destination are collected for read_multi(0, 0).
+ *
+ * Instructions appended between program_begin() and program_end() are
+ * loaded into the sequencer program memory instead of executed. A
+ * running program streams its read results, which are collected with
+ * read_stream(). Sending anything else stops the program, but results
+ * it already streamed stay queued ahead of the next reads, so stop it
+ * with halt() outside of a program, which resets the sequencer and
+ * flushes both FIFOs. Program memory is kept. Instructions appended but
+ * not yet run are kept and sent by the next run().
+ *
+ * With 16 byte FIFO words, run() pads the instructions with NOPs and an
+ * odd number of reads with a timestamp, a program must produce an even
+ * number of results for read_stream().
+ */
+
 class Sequencer {
 private:
+	struct read_binding {
+		void *dst; // NULL: append to results
+		size_t count;
+		int width; // bytes per destination element: 1, 4 or 8
+	};
 	Hififo * wf;
 	Hififo * rf;
-	std::vector<uint64_t> wbufv;
-	std::vector<uint64_t> rbufv;
+	bool owned; // wf and rf were opened here
+	std::vector<uint64_t> wbufv; // encoded instructions
+	std::vector<uint64_t> rbufv; // read data before scatter
+	std::vector<read_binding> bindings;
+	std::vector<uint64_t> results; // reads without a destination
     	size_t reads_expected;
+	uint64_t pad; // destination of the read padding run() adds
+	size_t program_start; // wbufv index of the program being built
+	bool recording;
+	void read_instr(size_t count, uint32_t address, bool increment,
+			void *dst, int width);
+	void bind(size_t count, void *dst, int width);
+	void scatter();
+	void init();
 public:
 	Sequencer(const char * filename_write, const char * filename_read);
+	Sequencer(Hififo *write, Hififo *read);
 	~Sequencer();
 	void append(uint64_t data);
 	void wait(uint64_t count);
 	void write_req(size_t count, uint32_t address, uint64_t * data);
 	void write_single(uint32_t address, uint64_t data);
 	void read_req(size_t count, uint32_t address);
+	void read_req(size_t count, uint32_t address, uint64_t *dst);
+	void read_req(size_t count, uint32_t address, uint32_t *dst);
+	void read_req(size_t count, uint32_t address, char *dst); // low bytes
 	void run();
 	void write (uint32_t address, uint64_t data, uint64_t count);
 	uint64_t read(uint32_t address);
 	void read_multi(uint32_t address, void *data, uint64_t count);
+	// FPGA clock cycle count when the instruction executes
+	void timestamp(uint64_t *dst = NULL);
 	std::vector<uint64_t> read_multi(uint32_t address, uint64_t count);
+	// program memory
+	void program_begin();
+	void program_end(uint32_t address);
+	void run_program(uint32_t address);
+	void loop(uint32_t address, uint16_t count); // count = 0: forever
+	void halt();
+	void read_stream(uint64_t *dst, size_t count);
 };
@@ -42,12 +42,9 @@ void SPI_Config::txrx(char * data, int len, int read_offset)
 		seq->write_single(spi_address, d_next);
 		seq->wait(360);
 		if((read_offset >= 0) && (i >= read_offset))
-			seq->read_req(1, spi_address);
+			seq->read_req(1, spi_address, &data[i - read_offset]);
 	}
 	if(read_offset < 0)
 		return;
-	std::vector<uint64_t> rdata64 = seq->read_multi(0, 0);
-	for(int i=0; i<(len-read_offset); i++)
-		data[i] = rdata64[i];
-	return;
+	seq->run();
 }
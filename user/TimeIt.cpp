@@ -22,12 +22,12 @@
 using namespace std;
 
 TimeIt::TimeIt(void){
-	clock_gettime(CLOCK_REALTIME, &_start_time);
+	clock_gettime(CLOCK_MONOTONIC, &_start_time);
 }
 
 double TimeIt::elapsed(){
 	struct timespec stop_time;
-	clock_gettime(CLOCK_REALTIME, &stop_time);
+	clock_gettime(CLOCK_MONOTONIC, &stop_time);
 	return (stop_time.tv_sec - _start_time.tv_sec) +
 		1e-9 * (stop_time.tv_nsec - _start_time.tv_nsec);
 };
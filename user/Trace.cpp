@@ -0,0 +1,106 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+
+#include "Trace.h"
+
+using namespace std;
+
+static std::mutex rings_lock;
+static vector<trace_ring *> rings; // kept after thread exit for export
+static uint64_t base_ticks;
+static uint64_t base_ns;
+
+static uint64_t raw_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+trace_ring * trace_ring_register()
+{
+	trace_ring *ring = new trace_ring;
+	ring->head = 0;
+	ring->tid = syscall(SYS_gettid);
+	std::lock_guard<std::mutex> lock(rings_lock);
+	if(rings.empty()){
+		base_ticks = trace_now();
+		base_ns = raw_ns();
+	}
+	rings.push_back(ring);
+	return ring;
+}
+
+static void json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for(; *s; s++){
+		if((*s == '"') || (*s == '\\'))
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+void trace_export(const char *filename)
+{
+	std::lock_guard<std::mutex> lock(rings_lock);
+	if(rings.empty())
+		return;
+	// ticks per microsecond, measured from the first registration to now
+	double scale = 1.0;
+	uint64_t now_ns = raw_ns();
+	if(now_ns > base_ns)
+		scale = 1e3 * (trace_now() - base_ticks) / (now_ns - base_ns);
+	FILE *f = fopen(filename, "w");
+	if(f == NULL)
+		throw std::runtime_error("hififo failed to open trace file");
+	int pid = getpid();
+	bool first = true;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for(auto ring : rings){
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for(uint64_t i=start; i<head; i++){
+			trace_event & e = ring->events[i & (TRACE_RING_SIZE - 1)];
+			fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+			json_string(f, e.name);
+			fprintf(f, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+				e.phase, ((int64_t) (e.ts - base_ticks)) / scale,
+				pid, ring->tid);
+			if(e.phase == 'C')
+				fprintf(f, ",\"args\":{\"value\":%lld}",
+					(long long) e.value);
+			if(e.phase == 'i')
+				fprintf(f, ",\"s\":\"t\"");
+			fputc('}', f);
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
@@ -0,0 +1,102 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Hot path tracing. Build with -DHIFIFO_TRACE (make TRACE=1) to enable,
+ * otherwise the TRACE_ macros compile to nothing.
+ *
+ * Each thread records into its own ring of TRACE_RING_SIZE events and
+ * overwrites the oldest, so recording takes no locks and no system calls.
+ * Timestamps are TSC ticks on x86 and CLOCK_MONOTONIC_RAW elsewhere.
+ * trace_export writes every ring as Chrome trace JSON, which loads in
+ * chrome://tracing and Perfetto. Event names must be string literals.
+ */
+
+#define TRACE_RING_SIZE 65536 // events per thread, power of 2
+
+struct trace_event {
+	uint64_t ts;
+	const char *name;
+	int64_t value;
+	char phase; // Chrome trace phase: B, E, C or i
+};
+
+struct trace_ring {
+	std::atomic<uint64_t> head; // events ever recorded
+	int tid;
+	trace_event events[TRACE_RING_SIZE];
+};
+
+trace_ring * trace_ring_register();
+void trace_export(const char *filename);
+
+static inline uint64_t trace_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return t.tv_sec * 1000000000L + t.tv_nsec;
+#endif
+}
+
+inline void trace_record(char phase, const char *name, int64_t value = 0)
+{
+	static thread_local trace_ring *ring = NULL;
+	if(ring == NULL)
+		ring = trace_ring_register();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	trace_event & e = ring->events[head & (TRACE_RING_SIZE - 1)];
+	e.ts = trace_now();
+	e.name = name;
+	e.value = value;
+	e.phase = phase;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+class TraceSpan {
+private:
+	const char *name;
+public:
+	TraceSpan(const char *name) : name(name) { trace_record('B', name); }
+	~TraceSpan() { trace_record('E', name); }
+};
+
+#ifdef HIFIFO_TRACE
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CAT(trace_span_, __LINE__){name}
+#define TRACE_COUNTER(name, v) trace_record('C', name, v)
+#define TRACE_INSTANT(name) trace_record('i', name)
+#define TRACE_EXPORT(filename) trace_export(filename)
+#else
+#define TRACE_SCOPE(name) do {} while(0)
+#define TRACE_COUNTER(name, v) do {} while(0)
+#define TRACE_INSTANT(name) do {} while(0)
+#define TRACE_EXPORT(filename) do {} while(0)
+#endif
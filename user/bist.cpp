@@ -0,0 +1,258 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+/*
+ * DMA throughput against the FPGA BIST source and sink on channel 2,
+ * see hdl/bist.v, so the host side can be taken away a layer at a time.
+ *
+ * to PC:   the FPGA generates, the host reads
+ * from PC: the host writes, the FPGA checks
+ *
+ * Host layers:
+ * raw:    read(2) / write(2) into one buffer, the driver alone
+ * lib:    Hififo get_buffer / put_buffer, data not touched
+ * verify: as lib, the host also generates or checks the pattern
+ *
+ * The FPGA rate is from its own word counts and cycle spans, which are
+ * 32 bits, 17 s at 250 MHz. Less the cycles the source waited on a full
+ * host ring it is the DMA engine rate.
+ *
+ * To compare the driver's coherent and streaming rings run the raw layer
+ * with the module loaded each way, dma_streaming=0 or 1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include "TimeIt.h"
+#include "Hififo.h"
+#include "Sequencer.h"
+#include "Pattern.h"
+
+using namespace std;
+
+#define CLOCK_MHZ 250.0
+
+// sequencer registers, see hdl/top.v
+#define BIST_SRC_CTL 16 // read: words
+#define BIST_SRC_SEED 17 // read: span
+#define BIST_SNK_CTL 18 // read: words
+#define BIST_SNK_ERRORS 19
+#define BIST_SNK_SPAN 20
+#define BIST_ENABLE 1
+#define BIST_LFSR 2
+#define BIST_CHECK 4
+
+enum layer { LAYER_RAW, LAYER_LIB, LAYER_VERIFY };
+
+/* ring mode of the loaded driver, to compare runs across module loads */
+static const char * dma_mode()
+{
+	FILE *fp = fopen("/sys/module/hififo/parameters/dma_streaming", "r");
+	if(fp == NULL)
+		return "coherent";
+	int c = fgetc(fp);
+	fclose(fp);
+	return (c == 'Y') ? "streaming" : "coherent";
+}
+
+static void usage(const char *name)
+{
+	cerr << "usage: " << name << " [options]\n"
+	     << "  -d prefix   device prefix, default /dev/hififo_0_\n"
+	     << "  -c nch      channels each way, default 4\n"
+	     << "  -w          from PC, default to PC\n"
+	     << "  -l layer    raw, lib or verify, default lib\n"
+	     << "  -p pattern  counter or lfsr, default lfsr\n"
+	     << "  -n bytes    default 1 GiB\n"
+	     << "  -b bytes    block size, default 4 MiB\n";
+}
+
+// discard whatever the source left in the FPGA FIFO and host ring
+static void drain(Hififo *f, size_t bs)
+{
+	f->set_timeout(0.01);
+	while(f->get_buffer(bs) != NULL)
+		;
+	f->set_timeout(1.0);
+}
+
+static double mbps(uint64_t bytes, double seconds)
+{
+	return seconds > 0 ? 1e-6 * bytes / seconds : 0;
+}
+
+int main ( int argc, char **argv )
+{
+	string prefix = "/dev/hififo_0_";
+	int nch = 4;
+	bool from_pc = false;
+	layer mode = LAYER_LIB;
+	bool lfsr = true;
+	uint64_t bytes = 1L << 30;
+	size_t bs = 4 << 20;
+	int opt;
+
+	while((opt = getopt(argc, argv, "d:c:wl:p:n:b:h")) != -1){
+		switch(opt){
+		case 'd': prefix = optarg; break;
+		case 'c': nch = atoi(optarg); break;
+		case 'w': from_pc = true; break;
+		case 'l':
+			if(strcmp(optarg, "raw") == 0)
+				mode = LAYER_RAW;
+			else if(strcmp(optarg, "verify") == 0)
+				mode = LAYER_VERIFY;
+			else
+				mode = LAYER_LIB;
+			break;
+		case 'p': lfsr = strcmp(optarg, "counter") != 0; break;
+		case 'n': bytes = strtoul(optarg, NULL, 0); break;
+		case 'b': bs = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	Hififo seq_w{(prefix + "1").c_str()};
+	Hififo seq_r{(prefix + to_string(nch + 1)).c_str()};
+	Sequencer seq{&seq_w, &seq_r};
+	string dev = prefix + (from_pc ? "2" : to_string(nch + 2));
+	size_t word = seq_w.word_bytes();
+	bs -= bs % word;
+	bytes -= bytes % bs;
+	if(bs == 0 || bytes == 0){
+		usage(argv[0]);
+		return 1;
+	}
+	uint64_t seed = 0x0123456789ABCDEF;
+	uint64_t ctl = BIST_ENABLE | (lfsr ? BIST_LFSR : 0);
+	pattern_type type = lfsr ? PATTERN_LFSR : PATTERN_COUNTER;
+
+	// stop the source, clean up after the last run
+	seq.write_single(BIST_SRC_CTL, 0);
+	seq.run();
+	if(!from_pc){
+		Hififo d{dev.c_str()};
+		drain(&d, bs);
+	}
+	Hififo *f = NULL;
+	int fd = -1;
+	if(mode == LAYER_RAW){
+		fd = open(dev.c_str(), O_RDWR);
+		if(fd < 0){
+			perror(dev.c_str());
+			return 1;
+		}
+	}
+	else
+		f = new Hififo{dev.c_str()};
+	if(!from_pc){
+		seq.write_single(BIST_SRC_SEED, seed);
+		seq.write_single(BIST_SRC_CTL, ctl);
+	}
+	else
+		seq.write_single(BIST_SNK_CTL, ctl |
+				 (mode == LAYER_VERIFY ? BIST_CHECK : 0));
+	seq_w.clear_counters();
+	seq.run();
+
+	vector<uint64_t> buf(bs / 8, 0);
+	Pattern pattern{type, seed};
+	TimeIt timer{};
+	for(uint64_t i=0; i<bytes; i+=bs){
+		if(mode == LAYER_RAW){
+			ssize_t rc = from_pc ? write(fd, &buf[0], bs) :
+				read(fd, &buf[0], bs);
+			if((size_t) rc != bs)
+				throw std::runtime_error( "hififo bist transfer failed" );
+		}
+		else if(from_pc){
+			uint64_t *p = (uint64_t *) f->get_buffer(bs);
+			if(mode == LAYER_VERIFY)
+				pattern.generate(p, bs / 8);
+			f->put_buffer(bs);
+		}
+		else{
+			uint64_t *p = (uint64_t *) f->get_buffer(bs);
+			if(p == NULL)
+				throw std::runtime_error( "hififo bist read timeout" );
+			if(mode == LAYER_VERIFY)
+				pattern.check(p, bs / 8);
+		}
+	}
+	double host_time = timer.elapsed();
+
+	// let the sink finish what was written
+	uint64_t words = bytes / word;
+	for(int i=0; from_pc && (i < 1000); i++)
+		if((uint32_t) seq.read(BIST_SNK_CTL) == (uint32_t) words)
+			break;
+	hififo_counters c;
+	seq_w.get_counters(&c);
+	uint64_t fpga_words, span, stall, errors = 0;
+	if(from_pc){
+		fpga_words = (uint32_t) seq.read(BIST_SNK_CTL);
+		span = (uint32_t) seq.read(BIST_SNK_SPAN);
+		errors = (uint32_t) seq.read(BIST_SNK_ERRORS);
+		stall = 0; // the sink never holds off, the ring empties instead
+	}
+	else{
+		fpga_words = (uint32_t) seq.read(BIST_SRC_CTL);
+		span = (uint32_t) seq.read(BIST_SRC_SEED);
+		stall = c.tpc[2].host_stall;
+		// back to the power on counter
+		seq.write_single(BIST_SRC_SEED, 0);
+		seq.write_single(BIST_SRC_CTL, BIST_ENABLE);
+		seq.run();
+	}
+	if(from_pc)
+		seq.write_single(BIST_SNK_CTL, BIST_ENABLE);
+	seq.run();
+
+	double fpga_time = span / (CLOCK_MHZ * 1e6);
+	double engine_time = (span > stall ? span - stall : 0) /
+		(CLOCK_MHZ * 1e6);
+	const char *names[] = {"raw", "lib", "verify"};
+	printf("%s, %s layer, %lu bytes in %lu byte blocks, %zu byte words, "
+	       "%s DMA\n", from_pc ? "from PC" : "to PC", names[mode], bytes,
+	       bs, word, dma_mode());
+	printf("  host   %8.1f MB/s\n", mbps(bytes, host_time));
+	printf("  FPGA   %8.1f MB/s, %lu words in %lu cycles\n",
+	       mbps(word * fpga_words, fpga_time), fpga_words, span);
+	if(!from_pc)
+		printf("  engine %8.1f MB/s, less %lu cycles host ring full\n",
+		       mbps(word * fpga_words, engine_time), stall);
+	if(mode == LAYER_VERIFY){
+		if(from_pc)
+			printf("  FPGA check: %lu qword errors\n", errors);
+		else
+			pattern.report("host check");
+	}
+	if(fd >= 0)
+		close(fd);
+	delete f;
+	return (errors != 0) || (pattern.errors.word_errors != 0);
+}
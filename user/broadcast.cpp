@@ -0,0 +1,62 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "Hififo.h"
+#include "Broadcast.h"
+
+using namespace std;
+
+static BroadcastProducer *producer = NULL;
+
+static void handle_sigint(int sig)
+{
+	if(producer != NULL)
+		producer->stop();
+}
+
+int main ( int argc, char **argv )
+{
+	if(argc < 3){
+		cerr << "usage: " << argv[0]
+		     << " /dev/hififo_0_4 name [block KB] [slots] [drop|throttle]\n";
+		return 1;
+	}
+	size_t block_size = argc > 3 ? 1024L * atol(argv[3]) : 1<<20;
+	size_t nslots = argc > 4 ? atol(argv[4]) : 64;
+	broadcast_policy policy = BROADCAST_DROP;
+	if((argc > 5) && (strcmp(argv[5], "throttle") == 0))
+		policy = BROADCAST_THROTTLE;
+
+	Hififo fifo{argv[1], true};
+	fifo.set_timeout(5.0);
+	BroadcastProducer bp{&fifo, argv[2], block_size, nslots, policy};
+	producer = &bp;
+	signal(SIGINT, handle_sigint);
+	signal(SIGTERM, handle_sigint);
+	bp.run();
+	producer = NULL;
+	cerr << "broadcast stopped, producer throttled " << bp.throttled << " times\n";
+	return 0;
+}
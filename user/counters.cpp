@@ -0,0 +1,176 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+/*
+ * Hardware performance counters, sampled at an interval.
+ *
+ * Each line is one interval. Stall counts are shown as a percentage of
+ * clock cycles, so the largest one names the limit of a slow stream:
+ * TX backpressure from the PCIe core, all read tags outstanding, user
+ * logic not draining or filling its FIFO, or the host ring.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include "Hififo.h"
+
+using namespace std;
+
+static void usage(const char *name)
+{
+	cerr << "usage: " << name << " [options]\n"
+	     << "  -d prefix   device prefix, default /dev/hififo_0_\n"
+	     << "  -f fifo     FIFO device to query, default first not open\n"
+	     << "  -i seconds  interval, default 1\n"
+	     << "  -n count    intervals, default 0 = forever\n";
+}
+
+static double pct(uint32_t n, uint32_t cycles)
+{
+	return cycles == 0 ? 0 : 100.0 * n / cycles;
+}
+
+// the counters wrap at 32 bits, deltas are taken modulo 2^32
+static void delta(hififo_counters *d, const hififo_counters *a,
+		  const hififo_counters *b)
+{
+	const uint32_t *pa = (const uint32_t *) a;
+	const uint32_t *pb = (const uint32_t *) b;
+	uint32_t *pd = (uint32_t *) d;
+	for(size_t i=0; i<sizeof(*d)/4; i++)
+		pd[i] = pb[i] - pa[i];
+	// maximums and occupancy are not cumulative
+	for(int i=0; i<4; i++){
+		d->fpc[i].latency_max = b->fpc[i].latency_max;
+		d->fpc[i].occupancy = b->fpc[i].occupancy;
+	}
+}
+
+/*
+ * the card counts the first 4 channels each way, nch numbers the to PC
+ * devices and word is the FIFO word bytes
+ */
+static void report(const hififo_counters *d, int nch, size_t word)
+{
+	uint32_t c = d->cycles;
+	printf("tx busy %5.1f%% stall %5.1f%%, rx busy %5.1f%%, "
+	       "TLPs tx %u rr %u wr %u cpl, rx %u\n",
+	       pct(d->tx_busy, c), pct(d->tx_stall, c), pct(d->rx_busy, c),
+	       d->tx_read_requests, d->tx_writes, d->tx_completions,
+	       d->rx_tlps);
+	const char *limit = "none";
+	double worst = 1.0; // percent, ignore noise
+	if(pct(d->tx_stall, c) > worst){
+		worst = pct(d->tx_stall, c);
+		limit = "PCIe TX backpressure";
+	}
+	for(int i=0; i<4; i++){
+		if(d->fpc[i].requests == 0)
+			continue;
+		printf("  fpc %d: %u requests, latency avg %.0f max %u cycles, "
+		       "tags out %5.1f%%, user full %5.1f%%, "
+		       "in flight %u to %u qwords\n",
+		       i, d->fpc[i].requests,
+		       (double) d->fpc[i].latency_sum / d->fpc[i].requests,
+		       d->fpc[i].latency_max, pct(d->fpc[i].tag_stall, c),
+		       pct(d->fpc[i].full_stall, c),
+		       d->fpc[i].occupancy & 0xFFFF, d->fpc[i].occupancy >> 16);
+		if(pct(d->fpc[i].tag_stall, c) > worst){
+			worst = pct(d->fpc[i].tag_stall, c);
+			limit = "read tags outstanding";
+		}
+		if(pct(d->fpc[i].full_stall, c) > worst){
+			worst = pct(d->fpc[i].full_stall, c);
+			limit = "user logic not draining";
+		}
+	}
+	for(int i=0; i<4; i++){
+		if(d->tpc[i].words == 0)
+			continue;
+		printf("  tpc %d: %.1f MB/s, arbiter %5.1f%%, user empty %5.1f%%, "
+		       "host full %5.1f%%\n",
+		       nch+i, (double) word * d->tpc[i].words * 250.0 / c,
+		       pct(d->tpc[i].grant_stall, c), pct(d->tpc[i].empty, c),
+		       pct(d->tpc[i].host_stall, c));
+		if(pct(d->tpc[i].empty, c) > worst){
+			worst = pct(d->tpc[i].empty, c);
+			limit = "user logic not filling";
+		}
+		if(pct(d->tpc[i].host_stall, c) > worst){
+			worst = pct(d->tpc[i].host_stall, c);
+			limit = "host not reading";
+		}
+	}
+	printf("  limit: %s\n", limit);
+}
+
+int main ( int argc, char **argv )
+{
+	string prefix = "/dev/hififo_0_";
+	int fifo = -1;
+	double interval = 1.0;
+	uint64_t count = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "d:f:i:n:h")) != -1){
+		switch(opt){
+		case 'd': prefix = optarg; break;
+		case 'f': fifo = atoi(optarg); break;
+		case 'i': interval = atof(optarg); break;
+		case 'n': count = atol(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	// the counters are card wide, any FIFO device not in use will do
+	for(int i=0; (fifo < 0) && (i < 8); i++){
+		string name = prefix + to_string(i);
+		int fd = open(name.c_str(), O_RDWR);
+		if(fd >= 0){
+			close(fd);
+			fifo = i;
+		}
+	}
+	if(fifo < 0){
+		cerr << "no free hififo device\n";
+		return 1;
+	}
+	Hififo f{(prefix + to_string(fifo)).c_str()};
+	// older drivers do not report the channel count, those had 4
+	int nch = f.channels() ? f.channels() : 4;
+
+	hififo_counters prev, cur, d;
+	f.clear_counters();
+	f.get_counters(&prev);
+	for(uint64_t n=0; (count == 0) || (n < count); n++){
+		usleep((useconds_t) (interval * 1e6));
+		f.get_counters(&cur);
+		delta(&d, &prev, &cur);
+		report(&d, nch, f.word_bytes());
+		prev = cur;
+	}
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+/*
+ * Round trip latency of minimal sequencer transactions.
+ *
+ * Each transaction is a single word read through the sequencer FIFOs.
+ * With -t the word read is the FPGA cycle counter, which splits each
+ * round trip into request and completion legs. The device clock rate and
+ * offset are fitted over the run, so the legs are reported as the excess
+ * over the fastest sample rather than as absolute one way delays.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include "Hififo.h"
+#include "Sequencer.h"
+#include "Histogram.h"
+
+using namespace std;
+
+#define SEQ_TEST 0
+#define SEQ_CYCLES 6
+
+struct sample {
+	uint64_t t_send; // host ns
+	uint64_t t_recv; // host ns
+	uint64_t cycles; // FPGA clock cycles
+};
+
+static std::atomic<bool> load_run{true};
+
+static inline uint64_t now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+static void spin_until(uint64_t t)
+{
+	while(now_ns() < t)
+		;
+}
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec ts;
+	ts.tv_sec = t / 1000000000L;
+	ts.tv_nsec = t % 1000000000L;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static void load_writer(string dev)
+{
+	Hififo f{dev.c_str(), true};
+	f.set_timeout(0.5);
+	vector<char> buf(1<<20, 0);
+	try{
+		while(load_run)
+			f.bwrite(&buf[0], buf.size());
+	}
+	catch(const hififo_timeout & e){
+		cerr << dev << ": load writer timed out\n";
+	}
+}
+
+static void load_reader(string dev)
+{
+	Hififo f{dev.c_str(), true};
+	f.set_timeout(0.5);
+	vector<char> buf(1<<20);
+	try{
+		while(load_run)
+			f.bread(&buf[0], buf.size());
+	}
+	catch(const hififo_timeout & e){
+		if(load_run)
+			cerr << dev << ": load reader timed out\n";
+	}
+}
+
+// least squares fit of cycles against host time, returns residual legs
+static void split_legs(vector<sample> & s, Histogram & req, Histogram & cpl)
+{
+	size_t n = s.size();
+	double mx = 0, my = 0, sxx = 0, sxy = 0;
+	for(auto & x : s){
+		mx += 0.5 * (x.t_send + x.t_recv - 2*s[0].t_send);
+		my += x.cycles - s[0].cycles;
+	}
+	mx /= n;
+	my /= n;
+	for(auto & x : s){
+		double dx = 0.5 * (x.t_send + x.t_recv - 2*s[0].t_send) - mx;
+		double dy = (double) (x.cycles - s[0].cycles) - my;
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+	double rate = sxy / sxx; // cycles per ns
+	cerr << "FPGA clock " << rate * 1e3 << " MHz\n";
+	// device time in host ns, up to a constant offset
+	vector<double> d(n);
+	double min_req = 1e300, min_cpl = 1e300;
+	for(size_t i=0; i<n; i++){
+		d[i] = (s[i].cycles - s[0].cycles) / rate;
+		min_req = min(min_req, d[i] - (s[i].t_send - s[0].t_send));
+		min_cpl = min(min_cpl, (s[i].t_recv - s[0].t_send) - d[i]);
+	}
+	for(size_t i=0; i<n; i++){
+		req.record(d[i] - (s[i].t_send - s[0].t_send) - min_req);
+		cpl.record((s[i].t_recv - s[0].t_send) - d[i] - min_cpl);
+	}
+}
+
+static void usage(const char *name)
+{
+	cerr << "usage: " << name << " [options]\n"
+	     << "  -d prefix   device prefix, default /dev/hififo_0_\n"
+	     << "  -n count    transactions, default 1000000\n"
+	     << "  -g usec     gap between transactions, default 0\n"
+	     << "  -s          sleep during the gap instead of busy polling\n"
+	     << "  -l streams  bulk load streams, 0 to 3, default 0\n"
+	     << "  -c cpu      pin the measuring thread to cpu\n"
+	     << "  -t          read FPGA timestamps to split the round trip\n";
+}
+
+int main ( int argc, char **argv )
+{
+	string prefix = "/dev/hififo_0_";
+	uint64_t count = 1000000;
+	uint64_t gap = 0;
+	bool use_sleep = false;
+	int nload = 0;
+	int cpu = -1;
+	bool timestamps = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "d:n:g:sl:c:th")) != -1){
+		switch(opt){
+		case 'd': prefix = optarg; break;
+		case 'n': count = atol(optarg); break;
+		case 'g': gap = 1000L * atol(optarg); break;
+		case 's': use_sleep = true; break;
+		case 'l': nload = atoi(optarg); break;
+		case 'c': cpu = atoi(optarg); break;
+		case 't': timestamps = true; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if(cpu >= 0){
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if(sched_setaffinity(0, sizeof(set), &set) != 0)
+			throw std::runtime_error("hififo failed to pin thread");
+	}
+
+	// FIFO 0 loops back to 4, 2 is a sink and 6 a counter source
+	vector<thread> load;
+	if(nload > 0){
+		load.push_back(thread(load_writer, prefix + "0"));
+		load.push_back(thread(load_reader, prefix + "4"));
+	}
+	if(nload > 1)
+		load.push_back(thread(load_writer, prefix + "2"));
+	if(nload > 2)
+		load.push_back(thread(load_reader, prefix + "6"));
+
+	Sequencer seq{(prefix + "1").c_str(), (prefix + "5").c_str()};
+	Histogram rtt;
+	vector<sample> samples;
+	if(timestamps)
+		samples.reserve(count);
+
+	uint64_t address = timestamps ? SEQ_CYCLES : SEQ_TEST;
+	uint64_t t_next = now_ns();
+	for(uint64_t i=0; i<count; i++){
+		if(gap != 0){
+			t_next += gap;
+			if(use_sleep)
+				sleep_until(t_next);
+			else
+				spin_until(t_next);
+		}
+		sample s;
+		s.t_send = now_ns();
+		s.cycles = seq.read(address);
+		s.t_recv = now_ns();
+		rtt.record(s.t_recv - s.t_send);
+		if(timestamps)
+			samples.push_back(s);
+	}
+
+	load_run = false;
+	for(auto & t : load)
+		t.join();
+
+	cerr << (use_sleep ? "sleep" : "poll") << ", gap " << gap/1000
+	     << " us, " << nload << " load streams, cpu " << cpu << "\n";
+	rtt.report("round trip");
+	if(timestamps && (samples.size() > 1)){
+		Histogram req, cpl;
+		split_legs(samples, req, cpl);
+		req.report("request leg excess");
+		cpl.report("completion leg excess");
+	}
+	return 0;
+}
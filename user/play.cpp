@@ -0,0 +1,66 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdint.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "TimeIt.h"
+#include "Hififo.h"
+#include "Playback.h"
+
+using namespace std;
+
+static Playback *playback = NULL;
+
+static void handle_sigint(int sig)
+{
+	if(playback != NULL)
+		playback->stop();
+}
+
+int main ( int argc, char **argv )
+{
+	if(argc < 3){
+		cerr << "usage: " << argv[0]
+		     << " /dev/hififo_0_0 file [loops, 0 = until ^C]"
+		     << " [loop start] [loop length]\n";
+		return 1;
+	}
+	uint64_t loops = argc > 3 ? atol(argv[3]) : 1;
+	uint64_t start = argc > 4 ? atol(argv[4]) : 0;
+	uint64_t length = argc > 5 ? atol(argv[5]) : 0;
+
+	Hififo fifo{argv[1], true};
+	Playback pb{&fifo, argv[2]};
+	playback = &pb;
+	signal(SIGINT, handle_sigint);
+	TimeIt timer{};
+	if(loops == 1)
+		pb.play(start, length);
+	else
+		pb.loop(start, length, loops);
+	playback = NULL;
+	auto runtime = timer.elapsed();
+	cerr << "wrote " << pb.bytes_written << " bytes in " << runtime
+	     << " seconds, " << pb.bytes_written * 1.0e-6 / runtime << " MB/s\n";
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * HIFIFO: Harmon Instruments PCI Express to FIFO
+ * Copyright (C) 2014 Harmon Instruments, LLC
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+
+#include "Hififo.h"
+#include "Recorder.h"
+#include "TimeIt.h"
+
+using namespace std;
+
+static Recorder *recorder = NULL;
+static std::atomic<bool> stopping{false};
+
+static void handle_sigint(int sig)
+{
+	stopping = true;
+	if(recorder != NULL)
+		recorder->stop();
+}
+
+/* no user space buffers, the driver copies into the page cache */
+static int splice_record(Hififo *fifo, const char *filename, uint64_t length,
+			 size_t block_size)
+{
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0){
+		perror(filename);
+		return 1;
+	}
+	signal(SIGINT, handle_sigint);
+	TimeIt timer{};
+	uint64_t bytes = 0;
+	try{
+		while(!stopping && ((length == 0) || (bytes < length)))
+			bytes += fifo->splice_to(fd, block_size);
+	}
+	catch(const std::runtime_error & e){
+		cerr << "record: " << e.what() << "\n";
+	}
+	double elapsed = timer.elapsed();
+	close(fd);
+	cerr << "spliced " << bytes << " bytes in " << elapsed
+	     << " seconds, " << bytes * 1.0e-6 / elapsed << " MB/s\n";
+	return 0;
+}
+
+int main ( int argc, char **argv )
+{
+	if(argc < 3){
+		cerr << "usage: " << argv[0]
+		     << " /dev/hififo_0_4 file [MB, 0 = until ^C] [block KB]"
+		     << " [writers, 0 = splice]\n";
+		return 1;
+	}
+	uint64_t length = argc > 3 ? 1048576L * atol(argv[3]) : 0;
+	size_t block_size = argc > 4 ? 1024L * atol(argv[4]) : 4<<20;
+	int nwriters = argc > 5 ? atoi(argv[5]) : 4;
+
+	Hififo fifo{argv[1], true};
+	fifo.set_timeout(5.0);
+	if(nwriters == 0)
+		return splice_record(&fifo, argv[2], length, block_size);
+	Recorder rec{&fifo, argv[2], block_size, 4*(size_t) nwriters, nwriters};
+	recorder = &rec;
+	signal(SIGINT, handle_sigint);
+	rec.run(length);
+	recorder = NULL;
+
+	recorder_stats & s = rec.stats;
+	cerr << "recorded " << s.bytes << " bytes in " << s.elapsed
+	     << " seconds, " << s.bytes * 1.0e-6 / s.elapsed << " MB/s\n";
+	cerr << "storage stalls: " << s.stalls << ", " << s.stall_time
+	     << " seconds, max queued blocks " << s.max_queued << "\n";
+	return 0;
+}
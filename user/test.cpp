@@ -29,21 +29,17 @@
 #include "Hififo.h"
 #include "Sequencer.h"
 #include "Spi_Config.h"
+#include "Pattern.h"
+#include "Trace.h"
 
 using namespace std;
 
-static inline void init_array(uint64_t *buf, size_t count, uint64_t * start_count)
-{
-	for(size_t j=0; j<count; j++)
-		buf[j] = (*start_count)++;
-}
-
 void writer(Hififo *f, size_t count, int use_hp)
 {
 	ssize_t bs = 256*1024;
 	if(count < bs)
 		bs = count;
-	uint64_t wcount = 0xDEADE00000000000;
+	Pattern pattern{PATTERN_COUNTER, 0xDEADE00000000000};
 	TimeIt timer{};
 	for(uint64_t i=0; i<count; i+=bs){
 		uint64_t * buf = (uint64_t *) f->get_buffer(bs*8);
@@ -51,7 +47,7 @@ void writer(Hififo *f, size_t count, int use_hp)
 			cerr << "timed out\n";
 			throw std::runtime_error( "hififo write timeout" );
 		}
-		init_array(buf, bs, &wcount);
+		pattern.generate(buf, bs);
 		f->put_buffer(bs*8);
 	}
 	auto runtime = timer.elapsed();
@@ -62,9 +58,8 @@ void writer(Hififo *f, size_t count, int use_hp)
 
 void checker(Hififo *f, size_t count, int use_hp)
 {
-	uint64_t expected = 0;
+	Pattern pattern{PATTERN_COUNTER};
 	ssize_t bs = 256*1024;
-	int prints = 0;
 	TimeIt timer{};
 	for(uint64_t i=0; i<count; i+=bs){
 		uint64_t *buf;
@@ -72,39 +67,31 @@ void checker(Hififo *f, size_t count, int use_hp)
 			buf = (uint64_t *) f->get_buffer(bs*8);
 			if(!buf){
 				cerr << "read timed out\n";
+				break;
 			}
 		}
 		catch(const std::runtime_error & e){
 			cerr << "runtime error " << e.what() << "\n";
 			return;
 		}
-		for(unsigned int j=0; j<bs; j++){
-			if(expected != buf[j])
-			{
-				if(prints > 32)
-					break;
-				if(!((i==0) && (j==0)))
-					std::cerr << "error at " << i << " " << j << " rval = 0x" << std::hex << buf[j] << " expected = 0x" << expected << "\n" << std::dec;
-				prints++;
-			}
-			expected = buf[j] + 1;
-		}
+		pattern.check(buf, bs);
 		f->put_buffer(bs*8);
 	}
 	auto runtime = timer.elapsed();
 	auto speed = count * 8.0e-6 / runtime;
 	std::cerr << "read " << count*8L << " bytes in " << runtime\
 		  << " seconds, " << speed << " MB/s\n";
+	pattern.report("checker");
 }
 
 int main ( int argc, char **argv )
 {
 	uint64_t length = 1048576L*64;
 
-	Hififo f2{"/dev/hififo_0_2"};
-	Hififo f6{"/dev/hififo_0_6"};
-	Hififo f0{"/dev/hififo_0_0"};
-	Hififo f4{"/dev/hififo_0_4"};
+	Hififo f2{"/dev/hififo_0_2", true};
+	Hififo f6{"/dev/hififo_0_6", true};
+	Hififo f0{"/dev/hififo_0_0", true};
+	Hififo f4{"/dev/hififo_0_4", true};
 
 	cerr << "FPGA built on " << f0.get_fpga_build_time();
 
@@ -176,5 +163,6 @@ int main ( int argc, char **argv )
 	TimeIt timer{};
 	checker(&f4, length, 1);
 	cerr << timer.elapsed() << endl;
+	TRACE_EXPORT("test_trace.json");
   return 0;
 }